@@ -0,0 +1,229 @@
+
+/*
+ Benchmarks the fft kernels on the default device (see fft_benchmark.cpp), for the variants and the sizes
+ of the command line, and reports the min, median and 99th percentile durations of the kernels
+ and of the ffts measured on the host (end to end), in csv or json.
+
+ The examples of main.cpp explain the kernels one at a time, this executable compares them.
+ */
+
+#include "common_includes.cpp"
+#include "fft_benchmark.cpp"
+
+namespace {
+
+  void printUsage(std::ostream & os) {
+    os << "usage: gpgpu_benchmark [options]" << std::endl
+    << std::endl
+    << "  --list                 lists the variants, then exits" << std::endl
+    << "  --variants a,b,...     the variants to benchmark (default: all)" << std::endl
+    << "  --sizes MIN:MAX        the powers of two in [MIN, MAX] (default: 2:65536)" << std::endl
+    << "  --sizes a,b,...        the sizes (powers of two)" << std::endl
+    << "                         (sizes that don't fit the device are skipped)" << std::endl
+    << "  --iterations N         the maximum number of measured iterations (default: 1000)" << std::endl
+    << "  --max-seconds S        the maximum duration of a measurement (default: 1)" << std::endl
+    << "  --butterflies N        the butterflies per work item (default: auto, the smallest that fits a workgroup)" << std::endl
+    << "  --verify               verifies the results against the cpu" << std::endl
+    << "  --format csv|json      the format of the report (default: csv)" << std::endl
+    << "  --output FILE          writes the report in FILE instead of the standard output" << std::endl;
+  }
+
+  std::vector<std::string> split(std::string const & s, char sep) {
+    std::vector<std::string> res;
+    for(size_t begin = 0;;) {
+      size_t const end = s.find(sep, begin);
+      res.push_back(s.substr(begin, end - begin));
+      if(end == std::string::npos) {
+        return res;
+      }
+      begin = end + 1;
+    }
+  }
+
+  unsigned int parseSize(std::string const & s) {
+    char * end;
+    unsigned long const size = strtoul(s.c_str(), &end, 10);
+    if(s.empty() || *end || size < 2 || size > std::numeric_limits<unsigned int>::max() || !imajuscule::is_power_of_two(size)) {
+      throw "sizes must be powers of two >= 2";
+    }
+    return size;
+  }
+
+  std::vector<unsigned int> parseSizes(std::string const & s) {
+    std::vector<unsigned int> sizes;
+    auto const range = split(s, ':');
+    if(range.size() == 2) {
+      unsigned int const max = parseSize(range[1]);
+      for(unsigned long sz = parseSize(range[0]); sz <= max; sz *= 2) {
+        sizes.push_back(sz);
+      }
+    }
+    else {
+      for(auto const & sz : split(s, ',')) {
+        sizes.push_back(parseSize(sz));
+      }
+    }
+    return sizes;
+  }
+
+} // NS
+
+int main(int argc, char ** argv) {
+  using namespace imajuscule;
+
+  std::vector<FftBenchmarkVariant const *> variants;
+  for(auto const & v : fftBenchmarkVariants()) {
+    variants.push_back(&v);
+  }
+  std::vector<unsigned int> sizes = parseSizes("2:65536");
+  FftBenchmarkOptions options;
+  std::string format = "csv";
+  std::string output_path;
+
+  try {
+    for(int i=1; i<argc; ++i) {
+      std::string const arg = argv[i];
+      auto value = [&]() -> std::string {
+        if(i+1 >= argc) {
+          throw "missing value";
+        }
+        return argv[++i];
+      };
+      if(arg == "--help" || arg == "-h") {
+        printUsage(std::cout);
+        return 0;
+      }
+      else if(arg == "--list") {
+        for(auto const & v : fftBenchmarkVariants()) {
+          std::cout << v.name << "\t" << v.kernel_file << std::endl;
+        }
+        return 0;
+      }
+      else if(arg == "--variants") {
+        auto const names = value();
+        if(names != "all") {
+          variants.clear();
+          for(auto const & name : split(names, ',')) {
+            auto v = findFftBenchmarkVariant(name);
+            if(!v) {
+              throw "unknown variant (see --list)";
+            }
+            variants.push_back(v);
+          }
+        }
+      }
+      else if(arg == "--sizes") {
+        sizes = parseSizes(value());
+      }
+      else if(arg == "--iterations") {
+        options.n_iterations = atoi(value().c_str());
+        if(options.n_iterations <= 0) {
+          throw "iterations must be > 0";
+        }
+      }
+      else if(arg == "--max-seconds") {
+        options.max_seconds = atof(value().c_str());
+        if(options.max_seconds <= 0.) {
+          throw "max-seconds must be > 0";
+        }
+      }
+      else if(arg == "--butterflies") {
+        auto const n = value();
+        options.nButterfliesPerThread = (n == "auto") ? 0 : atoi(n.c_str());
+        if(options.nButterfliesPerThread < 0 ||
+           (n != "auto" && !is_power_of_two(options.nButterfliesPerThread))) {
+          throw "butterflies must be auto or a power of two";
+        }
+      }
+      else if(arg == "--verify") {
+        options.verify_results = true;
+      }
+      else if(arg == "--format") {
+        format = value();
+        if(format != "csv" && format != "json") {
+          throw "format must be csv or json";
+        }
+      }
+      else if(arg == "--output") {
+        output_path = value();
+      }
+      else {
+        throw "unknown option";
+      }
+    }
+  }
+  catch(char const * error) {
+    std::cerr << error << std::endl << std::endl;
+    printUsage(std::cerr);
+    return 1;
+  }
+
+  srand(0); // we use rand() as random number generator and we want reproducible results so we use a fixed seeed.
+
+  // Get platform and device information
+  cl_platform_id platform_id = NULL;
+  cl_device_id device_id = NULL;
+  cl_uint ret_num_devices;
+  cl_uint ret_num_platforms;
+  cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
+  CHECK_CL_ERROR(ret);
+  ret = clGetDeviceIDs( platform_id, CL_DEVICE_TYPE_DEFAULT, 1,
+                       &device_id, &ret_num_devices);
+  CHECK_CL_ERROR(ret);
+
+  // Create an OpenCL context
+  cl_context context = clCreateContext( NULL, 1, &device_id, NULL, NULL, &ret);
+  CHECK_CL_ERROR(ret);
+
+  // Create a command queue, with profiling enabled to measure the durations of the kernels
+  cl_command_queue command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+  CHECK_CL_ERROR(ret);
+
+  std::string const device = deviceString(device_id, CL_DEVICE_NAME).c_str();
+
+  // the progress is written in the standard error, so that the standard output is only the report.
+  std::vector<FftBenchmarkResult> results;
+  for(auto v : variants) {
+    for(auto size : sizes) {
+      FftBenchmarkResult r;
+      if(!benchmarkFft(context, device_id, command_queue, *v, size, options, r)) {
+        std::cerr << v->name << " " << size << ": skipped, not supported by the device" << std::endl;
+        continue;
+      }
+      std::cerr << v->name << " " << size << ": kernel median " << r.kernel.median << " us, end to end median "
+      << r.end_to_end.median << " us" << (r.verification.empty() ? "" : ", ") << r.verification << std::endl;
+      results.push_back(std::move(r));
+    }
+  }
+
+  {
+    std::ofstream file;
+    if(!output_path.empty()) {
+      file.open(output_path, std::ios::out | std::ios::trunc);
+      verify(file.is_open());
+    }
+    std::ostream & os = output_path.empty() ? std::cout : file;
+    if(format == "json") {
+      writeFftBenchmarkJson(os, device, results);
+    }
+    else {
+      writeFftBenchmarkCsv(os, device, results);
+    }
+    verify(static_cast<bool>(os));
+  }
+
+  // Clean up
+  ret = clFlush(command_queue);
+  CHECK_CL_ERROR(ret);
+  ret = clFinish(command_queue);
+  CHECK_CL_ERROR(ret);
+  ret = clReleaseCommandQueue(command_queue);
+  CHECK_CL_ERROR(ret);
+  KernelRegistry::getInstance().clear(context);
+  ret = clReleaseContext(context);
+  CHECK_CL_ERROR(ret);
+
+  bool const all_verified = std::all_of(results.begin(), results.end(),
+                                        [](FftBenchmarkResult const & r) { return r.verification != "error"; });
+  return all_verified ? 0 : 2;
+}
@@ -0,0 +1,59 @@
+
+// The includes of the executables (see main.cpp and benchmark.cpp).
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <unordered_set>
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "error_check.cpp"
+
+#include "read_kernel_source.cpp"
+#include "program_cache.cpp"
+
+#include "math.cpp"
+#include "bitReverse.cpp"
+#include "rand.cpp"
+#include "thread_pool.cpp"
+
+#include "cpu_fft_simd.cpp"
+#include "cpu_fft_codelets.cpp"
+#include "cpu_fft.cpp"
+#include "cpu_fft_norecursion.cpp"
+#include "convolution.cpp"
+#include "impulse_response_spectra.cpp"
+#include "kernel_variants.cpp"
+#include "fft_tuning.cpp"
+#include "gpu_fft_plan.cpp"
+#include "fft_autotuner.cpp"
+#include "convolution_opencl.cpp"
@@ -0,0 +1,673 @@
+
+/*
+ * Convolution of an audio stream with a (long) impulse response, for convolution reverbs.
+ */
+namespace imajuscule {
+
+  /*
+   * Uniformly partitioned overlap-save convolution (UPOLS).
+   *
+   * The impulse response is split in P partitions of B samples (B is the block size),
+   * whose spectra (ffts of size 2B, zero-padded) are computed once, in 'setup' (or precomputed, see 'setupSpectra').
+   *
+   * For every block of B input samples, the fft of the last 2B input samples is pushed
+   * in the frequency-domain delay line (the spectra of the P last windows), and the spectrum of the output is
+   *   Y = X[n] * H[0] + X[n-1] * H[1] + ... + X[n-P+1] * H[P-1]
+   * (in a single pass, see 'RealFBins_::multiply_add'). The last B samples of the inverse fft of Y
+   * are the output block (the first B samples are the circular part of the convolution, and are discarded).
+   *
+   * The output block is the convolution at the times of the input block, so there is no latency
+   * other than the buffering of B samples, and the cost per block is one forward and one inverse real fft
+   * of size 2B, and P multiply-adds of B+1 bins.
+   *
+   * 'process' doesn't allocate memory, so it can be called from a realtime thread.
+   */
+  template<typename T>
+  struct UniformPartitionedConvolution {
+    using Tag       = imj::Tag;
+    using Algo      = fft::Algo_<Tag, T>;
+    using FBins     = fft::RealFBins_<Tag, T>;
+    using Spectrum  = typename FBins::type;
+    using Contexts  = fft::Contexts_<Tag, T>;
+
+    /*
+     * 'block_size' is a power of two. The fft context of size 2 * 'block_size' is taken from
+     * the process-wide cache, and created if needed (so call 'setup' from a non-realtime thread).
+     */
+    void setup(T const * impulse_response,
+               unsigned int const ir_size,
+               unsigned int const block_size) {
+      verify(is_power_of_two(block_size));
+      unsigned int const n_partitions = countPartitions(ir_size, block_size);
+      own_spectra.resize(n_partitions * (block_size+1));
+      computeSpectra(impulse_response, ir_size, block_size, n_partitions, own_spectra.data());
+      setupSpectra(own_spectra.data(), n_partitions, block_size);
+    }
+
+    /*
+     * Uses the spectra computed by 'computeSpectra' (e.g. in a file, see 'ImpulseResponseSpectra')
+     * without copying them: 'spectra' must outlive the convolution.
+     */
+    void setupSpectra(std::complex<T> const * spectra,
+                      unsigned int const n_partitions,
+                      unsigned int const block_size) {
+      verify(is_power_of_two(block_size));
+      verify(n_partitions >= 1);
+      B = block_size;
+      unsigned int const N = 2*B;
+      algo.setContext(Contexts::getInstance().getBySize(N));
+
+      window.assign(N, T{});
+      time.assign(N, T{});
+      accum.assign(B+1, {});
+      fdl.assign(n_partitions, Spectrum(B+1));
+
+      ir_pointers.clear();
+      for(unsigned int p=0; p<n_partitions; ++p) {
+        ir_pointers.push_back(spectra + p * (B+1));
+      }
+      // the delay line is a ring whose pointers are duplicated, so that
+      // the P spectra from the newest to the oldest are contiguous: [head, head+P).
+      fdl_pointers.clear();
+      for(int i=0; i<2; ++i) {
+        for(auto const & x : fdl) {
+          fdl_pointers.push_back(x.data());
+        }
+      }
+      reset();
+
+      // sizes the scratch of the ffts, so that 'process' doesn't allocate, whatever the thread calling it
+      algo.forward_real(window.data(), accum, N, &workspace);
+      algo.inverse_real(accum, time, N, &workspace);
+      FBins::zero(accum);
+    }
+
+    static unsigned int countPartitions(unsigned int const ir_size, unsigned int const block_size) {
+      return std::max(1u, (ir_size + block_size - 1) / block_size);
+    }
+
+    /*
+     * Writes in 'spectra' the 'n_partitions' * ('block_size' + 1) bins of the spectra of the partitions
+     * of the impulse response (which is zero after 'ir_size' samples), scaled to compensate the scale of the inverse fft.
+     */
+    static void computeSpectra(T const * impulse_response,
+                               unsigned int const ir_size,
+                               unsigned int const block_size,
+                               unsigned int const n_partitions,
+                               std::complex<T> * spectra) {
+      unsigned int const B = block_size;
+      unsigned int const N = 2*B;
+      Algo algo(Contexts::getInstance().getBySize(N));
+      std::vector<T> window(N);
+      Spectrum spectrum(B+1);
+
+      T const scale = T(1) / static_cast<T>(N);
+      for(unsigned int p=0; p<n_partitions; ++p) {
+        std::fill(window.begin(), window.end(), T{});
+        unsigned int const begin = p*B;
+        unsigned int const end = std::min(ir_size, begin + B);
+        for(unsigned int i=begin; i<end; ++i) {
+          window[i-begin] = impulse_response[i] * scale;
+        }
+        algo.forward_real(window.data(), spectrum, N);
+        std::copy(spectrum.begin(), spectrum.end(), spectra + p * (B+1));
+      }
+    }
+
+    // Forgets the past input.
+    void reset() {
+      std::fill(window.begin(), window.end(), T{});
+      for(auto & x : fdl) {
+        FBins::zero(x);
+      }
+      head = 0;
+    }
+
+    unsigned int getBlockSize() const { return B; }
+    unsigned int countPartitions() const { return ir_pointers.size(); }
+
+    // Replaces the 'getBlockSize()' samples of 'block' by the next output samples.
+    void process(T * block) {
+      unsigned int const N = 2*B;
+      unsigned int const P = countPartitions();
+
+      std::copy(window.begin() + B, window.end(), window.begin());
+      std::copy(block, block + B, window.begin() + B);
+
+      head = (head ? head : P) - 1;
+      algo.forward_real(window.data(), fdl[head], N, &workspace);
+
+      FBins::zero(accum);
+      FBins::multiply_add(accum, &fdl_pointers[head], ir_pointers.data(), P);
+
+      algo.inverse_real(accum, time, N, &workspace);
+      std::copy(time.begin() + B, time.end(), block);
+    }
+
+  private:
+    unsigned int B = 0;
+    Algo algo;
+    // the scratch of the ffts of 'process' (the default workspaces of 'algo' are per thread)
+    typename Algo::Workspace workspace;
+
+    // the last 2B input samples
+    std::vector<T> window;
+    // the inverse fft of the output spectrum
+    std::vector<T> time;
+    Spectrum accum;
+
+    // the spectra of the partitions, when computed by 'setup'
+    std::vector<std::complex<T>> own_spectra;
+    std::vector<std::complex<T> const *> ir_pointers;
+
+    // the frequency-domain delay line: the newest spectrum is fdl[head], the oldest is fdl[(head+P-1) % P]
+    std::vector<Spectrum> fdl;
+    std::vector<std::complex<T> const *> fdl_pointers;
+    unsigned int head = 0;
+  };
+
+  // Timings of the blocks of one partition size of a 'NonUniformPartitionedConvolution'.
+  struct PartitionTimings {
+    unsigned int block_size;
+    unsigned int count_partitions;
+    // the offset of the first partition in the impulse response
+    unsigned int offset;
+    // false for the partitions computed by the audio thread
+    bool background;
+    // true for the partitions computed by a 'TailFactory' convolution (e.g. on a gpu)
+    bool offloaded;
+
+    unsigned int count_blocks;
+    double average_us;
+    double max_us;
+    // the number of blocks that were not computed in time (and were not played)
+    unsigned int missed_deadlines;
+  };
+
+  /*
+   * Non-uniformly partitioned convolution (Gardner's scheme): the head of the impulse response
+   * is convolved with small partitions, to have a low latency, and the tail with partitions
+   * whose size doubles every 2 partitions (up to 'max_block_size'), which need less cpu per sample.
+   *
+   * Every partition size is a 'UniformPartitionedConvolution', of block size L, whose first partition
+   * is at offset 2L (or more) in the impulse response:
+   * - the head (of block size B, 4 partitions) is computed by the audio thread, in 'process',
+   * - each tail size is computed by the worker threads: the block of L input samples that ends
+   *   at time t is convolved between t and t+L, and is played from t+L. The workers compute
+   *   the pending blocks by earliest deadline first, so that a block of a small tail size is
+   *   not delayed by the blocks of larger sizes.
+   *
+   * 'process' never waits for the workers: a block that is not computed in time is not played,
+   * and is counted in 'missed_deadlines' (unless 'setWaitForWorkers' is used, for offline rendering).
+   * When the workers are so late that the audio thread would overwrite a block they have not convolved yet,
+   * the input of the tail size is dropped until they have caught up, see 'feed'.
+   *
+   * The fft contexts of all sizes are taken from the process-wide cache.
+   *
+   * The largest tail sizes can be convolved elsewhere than on the cpu (e.g. on a gpu), see 'setTailFactory'.
+   */
+  template<typename T>
+  struct NonUniformPartitionedConvolution {
+    using Contexts = fft::Contexts_<imj::Tag, T>;
+
+    static constexpr unsigned int default_max_block_size = 8192;
+
+    NonUniformPartitionedConvolution(unsigned int n_workers = default_count_workers())
+    : n_workers(std::max(1u, n_workers))
+    {}
+
+    ~NonUniformPartitionedConvolution() {
+      stopWorkers();
+    }
+
+    // Convolves, in place, a block of the size of the partitions.
+    using BlockConvolution = std::function<void(T *)>;
+    // Returns the convolution of the blocks of 'block_size' samples with the 'ir_size' samples of 'ir'.
+    using TailFactory = std::function<BlockConvolution(T const * ir, unsigned int ir_size, unsigned int block_size)>;
+
+    /*
+     * The tail sizes of at least 'min_block_size' will be convolved (by the worker threads)
+     * with the convolutions returned by 'factory' (see 'makeOpenCLTailFactory'), instead of 'UniformPartitionedConvolution'.
+     * A worker convolving such a block waits for it (e.g. for the device), so one more worker may be needed.
+     * Such a convolution is not reset after dropped blocks (see 'feed'): until its partitions are flushed,
+     * its output mixes the input before and after the gap.
+     *
+     * Takes effect at the next 'setup'.
+     */
+    void setTailFactory(unsigned int const min_block_size, TailFactory factory) {
+      offload_min_block_size = min_block_size;
+      tail_factory = std::move(factory);
+    }
+
+    static unsigned int default_count_workers() {
+      // one core is used by the audio thread
+      return std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    // The partitions of one size: 'size' samples of the impulse response, starting at 'offset'.
+    struct Segment {
+      unsigned int block_size;
+      unsigned int offset;
+      unsigned int size;
+
+      unsigned int countPartitions() const {
+        return UniformPartitionedConvolution<T>::countPartitions(size, block_size);
+      }
+    };
+
+    /*
+     * Returns the partitioning of an impulse response of 'ir_size' samples:
+     * the head (of block size 'block_size', at offset 0), followed by the tail sizes.
+     *
+     * 'block_size' and 'max_block_size' are powers of two, 'max_block_size' >= 'block_size'
+     * (when they are equal, the convolution is uniform).
+     */
+    static std::vector<Segment> partition(unsigned int const ir_size,
+                                          unsigned int const block_size,
+                                          unsigned int const max_block_size = default_max_block_size) {
+      verify(is_power_of_two(block_size));
+      verify(is_power_of_two(max_block_size) && max_block_size >= block_size);
+      unsigned int const B = block_size;
+      unsigned int const head_end = std::min(ir_size, (max_block_size > B) ? 4*B : ir_size);
+      std::vector<Segment> segments{{B, 0, head_end}};
+      for(unsigned int L = 2*B, offset = head_end; offset < ir_size;) {
+        bool const last = L >= max_block_size;
+        // the next size starts at twice its block size.
+        unsigned int const end = last ? ir_size : std::min(ir_size, std::max(offset + L, 4*L));
+        segments.push_back({L, offset, end - offset});
+        offset = end;
+        if(!last) {
+          L *= 2;
+        }
+      }
+      return segments;
+    }
+
+    // see 'partition'
+    void setup(T const * impulse_response,
+               unsigned int const ir_size,
+               unsigned int const block_size,
+               unsigned int const max_block_size = default_max_block_size) {
+      auto const segments = partition(ir_size, block_size, max_block_size);
+      setupSegments(segments, [&](unsigned int i, Tail * t, UniformPartitionedConvolution<T> & conv) {
+        auto const & s = segments[i];
+        if(t && tail_factory && s.block_size >= offload_min_block_size) {
+          t->offloaded = tail_factory(impulse_response + s.offset, s.size, s.block_size);
+        }
+        else {
+          conv.setup(impulse_response + s.offset, s.size, s.block_size);
+        }
+      });
+    }
+
+    // The spectra of the partitions of a segment, computed by 'UniformPartitionedConvolution::computeSpectra'.
+    struct SegmentSpectra {
+      Segment segment;
+      // the number of spectra, which must be 'segment.countPartitions()'
+      unsigned int n_partitions;
+      std::complex<T> const * spectra;
+    };
+
+    // true when 'segments' are the ones returned by 'partition(ir_size, block_size, max_block_size)'
+    static bool isPartition(std::vector<Segment> const & segments,
+                            unsigned int const ir_size,
+                            unsigned int const block_size,
+                            unsigned int const max_block_size) {
+      if(!is_power_of_two(block_size) || !is_power_of_two(max_block_size) || max_block_size < block_size) {
+        return false;
+      }
+      auto const expected = partition(ir_size, block_size, max_block_size);
+      return std::equal(segments.begin(), segments.end(), expected.begin(), expected.end(),
+                        [](Segment const & a, Segment const & b) {
+        return a.block_size == b.block_size && a.offset == b.offset && a.size == b.size;
+      });
+    }
+
+    /*
+     * Uses precomputed spectra (e.g. of a file, see 'ImpulseResponseSpectra') without copying them:
+     * the spectra must outlive the convolution.
+     *
+     * The segments are the ones returned by 'partition'. The tail factory can't be used,
+     * because it needs the samples of the impulse response.
+     */
+    void setup(std::vector<SegmentSpectra> const & spectra) {
+      verify(!spectra.empty());
+      verify(!tail_factory);
+      std::vector<Segment> segments;
+      for(auto const & s : spectra) {
+        verify(s.n_partitions == s.segment.countPartitions());
+        segments.push_back(s.segment);
+      }
+      // the block size of the last segment is a valid 'max_block_size', that gives the same segments.
+      verify(isPartition(segments,
+                         segments.back().offset + segments.back().size,
+                         segments.front().block_size,
+                         segments.back().block_size));
+      setupSegments(segments, [&](unsigned int i, Tail *, UniformPartitionedConvolution<T> & conv) {
+        auto const & s = segments[i];
+        conv.setupSpectra(spectra[i].spectra, s.countPartitions(), s.block_size);
+      });
+    }
+
+    unsigned int getBlockSize() const { return B; }
+
+    /*
+     * When 'wait' is true, 'process' waits for the blocks computed by the workers
+     * instead of skipping them when they are late (for offline rendering, or for tests).
+     */
+    void setWaitForWorkers(bool wait) {
+      wait_for_workers = wait;
+    }
+
+    // Replaces the 'getBlockSize()' samples of 'block' by the next output samples.
+    void process(T * block) {
+      // give the input to the workers
+      bool notify = false;
+      for(auto & t : tails) {
+        auto const k = time / t->L;
+        unsigned int const pos = time % t->L;
+        if(pos == 0) {
+          t->feeding = feed(*t, k);
+        }
+        if(!t->feeding) {
+          continue;
+        }
+        std::copy(block, block + B, t->slot(k) + pos);
+        if(pos + B == t->L) {
+          t->submitted.store(k+1, std::memory_order_release);
+          notify = true;
+        }
+      }
+      if(notify) {
+        // (the workers also poll, in case a notification is lost because it is sent without the lock)
+        work_cv.notify_all();
+      }
+
+      {
+        auto const start = std::chrono::steady_clock::now();
+        head.process(block);
+        head_timings.add(std::chrono::steady_clock::now() - start);
+      }
+
+      for(auto & t : tails) {
+        if(time < t->offset) {
+          continue;
+        }
+        auto const played = time - t->offset;
+        auto const k = played / t->L;
+        unsigned int const pos = played % t->L;
+        if(pos == 0) {
+          t->playing = isComputed(*t, k);
+        }
+        if(t->playing) {
+          T const * const out = t->slot(k) + pos;
+          for(unsigned int i=0; i<B; ++i) {
+            block[i] += out[i];
+          }
+        }
+      }
+      time += B;
+    }
+
+    // The timings of the head, followed by the timings of the tail sizes.
+    std::vector<PartitionTimings> getTimings() const {
+      std::vector<PartitionTimings> res;
+      res.push_back(head_timings.get(B, head.countPartitions(), 0, false, false));
+      for(auto const & t : tails) {
+        res.push_back(t->timings.get(t->L, t->n_partitions, t->offset, true, static_cast<bool>(t->offloaded)));
+      }
+      return res;
+    }
+
+  private:
+    struct Timings {
+      std::atomic<uint64_t> total_ns{0};
+      std::atomic<uint64_t> max_ns{0};
+      std::atomic<unsigned int> count{0};
+      std::atomic<unsigned int> missed{0};
+
+      void reset() {
+        total_ns = 0;
+        max_ns = 0;
+        count = 0;
+        missed = 0;
+      }
+
+      // called by a single thread at a time
+      void add(std::chrono::steady_clock::duration d) {
+        uint64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        total_ns.store(total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        max_ns.store(std::max(ns, max_ns.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+
+      PartitionTimings get(unsigned int block_size, unsigned int n, unsigned int offset, bool background, bool offloaded) const {
+        unsigned int const c = count;
+        return {
+          block_size, n, offset, background, offloaded,
+          c,
+          c ? total_ns / (1000. * c) : 0.,
+          max_ns / 1000.,
+          missed
+        };
+      }
+    };
+
+    /*
+     * A tail size: the ring has 'n_slots' blocks of L samples: the block k is written by the audio thread
+     * during [kL, (k+1)L), then convolved in place by a worker during [(k+1)L, (k+2)L),
+     * then played during [(k+2)L, (k+3)L) (offset by the position of the partitions in the impulse response),
+     * so 3 slots are needed, and the 4th one tolerates a worker that is late by one block.
+     * A worker that is later than that would have its block overwritten: the blocks are dropped instead, see 'feed'.
+     */
+    static constexpr unsigned int n_slots = 4;
+
+    struct Tail {
+      unsigned int L;
+      unsigned int offset;
+      unsigned int n_partitions;
+      // 'offloaded' is used if set, else 'conv'
+      UniformPartitionedConvolution<T> conv;
+      BlockConvolution offloaded;
+      std::vector<T> ring;
+
+      // the number of blocks written by the audio thread
+      std::atomic<uint64_t> submitted{0};
+      // the number of blocks convolved by the workers
+      std::atomic<uint64_t> computed{0};
+      // true while a worker convolves a block
+      std::atomic<bool> busy{false};
+      // set by the audio thread when blocks were dropped: 'conv' is reset before the next block
+      std::atomic<bool> reset{false};
+
+      // (only used by the audio thread:)
+      // whether the block being played was computed in time
+      bool playing = false;
+      // whether the block being written is given to the workers
+      bool feeding = true;
+      // the blocks [drop_begin, drop_end) were dropped ('drop_end' is 'dropping' while they are)
+      uint64_t drop_begin = 0;
+      uint64_t drop_end = 0;
+
+      Timings timings;
+
+      T * slot(uint64_t k) {
+        return ring.data() + (k % n_slots) * L;
+      }
+    };
+
+    unsigned int B = 0;
+    unsigned int const n_workers;
+    bool wait_for_workers = false;
+    unsigned int offload_min_block_size = 0;
+    TailFactory tail_factory;
+    // the number of samples processed so far
+    uint64_t time = 0;
+
+    UniformPartitionedConvolution<T> head;
+    Timings head_timings;
+    std::vector<std::unique_ptr<Tail>> tails;
+
+    std::vector<std::thread> workers;
+    std::mutex work_mutex;
+    std::condition_variable work_cv;
+    bool stop = false;
+
+    /*
+     * 'setupConvolution(i, tail, conv)' sets up the convolution of the segment i:
+     * 'conv', or 'tail->offloaded' ('tail' is null for the head).
+     */
+    template<typename F>
+    void setupSegments(std::vector<Segment> const & segments, F setupConvolution) {
+      stopWorkers();
+      tails.clear();
+      B = segments[0].block_size;
+      time = 0;
+
+      std::vector<int> fft_sizes;
+      for(auto const & s : segments) {
+        fft_sizes.push_back(2*s.block_size);
+      }
+      Contexts::getInstance().prewarm(fft_sizes);
+
+      setupConvolution(0, nullptr, head);
+      head_timings.reset();
+      for(unsigned int i=1; i<segments.size(); ++i) {
+        auto const & s = segments[i];
+        auto t = std::make_unique<Tail>();
+        t->L = s.block_size;
+        t->offset = s.offset;
+        t->n_partitions = s.countPartitions();
+        setupConvolution(i, t.get(), t->conv);
+        t->ring.assign(n_slots * s.block_size, T{});
+        tails.push_back(std::move(t));
+      }
+      startWorkers(std::min<unsigned int>(n_workers, tails.size()));
+    }
+
+    static constexpr uint64_t dropping = std::numeric_limits<uint64_t>::max();
+
+    /*
+     * Called by the audio thread when the block k of a tail size starts: returns whether it is given to the workers.
+     *
+     * When the workers have not convolved the block 'n_slots' blocks before (which uses the same slot),
+     * the blocks are dropped (and are not played) until the workers have convolved every submitted block.
+     * Then the next block convolved is k, and 'conv' is reset by the worker before,
+     * so that the input before the gap is forgotten.
+     */
+    bool feed(Tail & t, uint64_t k) {
+      auto const computed = t.computed.load(std::memory_order_acquire);
+      if(t.drop_end == dropping) {
+        if(computed < t.submitted.load(std::memory_order_relaxed)) {
+          return false;
+        }
+        // no block is pending, so no worker writes 'computed'
+        t.drop_end = k;
+        // (published with 'submitted', at the end of the block k)
+        t.reset.store(true, std::memory_order_relaxed);
+        t.computed.store(k, std::memory_order_release);
+        return true;
+      }
+      if(computed + n_slots <= k) {
+        t.drop_begin = k;
+        t.drop_end = dropping;
+        return false;
+      }
+      return true;
+    }
+
+    bool isComputed(Tail & t, uint64_t k) {
+      if(k >= t.drop_begin && k < t.drop_end) {
+        t.timings.missed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      while(t.computed.load(std::memory_order_acquire) <= k) {
+        if(!wait_for_workers) {
+          t.timings.missed.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      return true;
+    }
+
+    void startWorkers(unsigned int n) {
+      stop = false;
+      for(unsigned int i=0; i<n; ++i) {
+        workers.emplace_back([this]() { work(); });
+      }
+    }
+
+    void stopWorkers() {
+      {
+        std::lock_guard<std::mutex> l(work_mutex);
+        stop = true;
+      }
+      work_cv.notify_all();
+      for(auto & w : workers) {
+        w.join();
+      }
+      workers.clear();
+    }
+
+    void work() {
+      while(true) {
+        if(auto t = claimEarliestDeadline()) {
+          auto const k = t->computed.load(std::memory_order_relaxed);
+          auto const start = std::chrono::steady_clock::now();
+          if(t->reset.exchange(false, std::memory_order_relaxed) && !t->offloaded) {
+            t->conv.reset();
+          }
+          if(t->offloaded) {
+            t->offloaded(t->slot(k));
+          }
+          else {
+            t->conv.process(t->slot(k));
+          }
+          t->timings.add(std::chrono::steady_clock::now() - start);
+          t->computed.store(k+1, std::memory_order_release);
+          t->busy.store(false, std::memory_order_release);
+          continue;
+        }
+        std::unique_lock<std::mutex> l(work_mutex);
+        if(stop) {
+          return;
+        }
+        work_cv.wait_for(l, std::chrono::milliseconds(1));
+      }
+    }
+
+    // Returns the tail having the pending block that is played first, after having marked it busy.
+    Tail * claimEarliestDeadline() {
+      while(true) {
+        Tail * earliest = nullptr;
+        uint64_t earliest_deadline = 0;
+        for(auto & t : tails) {
+          if(t->busy.load(std::memory_order_relaxed)) {
+            continue;
+          }
+          auto const k = t->computed.load(std::memory_order_relaxed);
+          if(k >= t->submitted.load(std::memory_order_acquire)) {
+            continue;
+          }
+          uint64_t const deadline = k * t->L + t->offset;
+          if(!earliest || deadline < earliest_deadline) {
+            earliest = t.get();
+            earliest_deadline = deadline;
+          }
+        }
+        if(!earliest) {
+          return nullptr;
+        }
+        if(!earliest->busy.exchange(true, std::memory_order_acquire)) {
+          if(earliest->computed.load(std::memory_order_relaxed) < earliest->submitted.load(std::memory_order_acquire)) {
+            return earliest;
+          }
+          // another worker has computed the block in the meantime
+          earliest->busy.store(false, std::memory_order_release);
+        }
+      }
+    }
+  };
+
+} // NS imajuscule
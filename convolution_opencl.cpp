@@ -0,0 +1,292 @@
+
+/*
+ * Convolution of the tail of an impulse response on an OpenCL device.
+ */
+namespace imajuscule {
+
+  /*
+   * Uniformly partitioned overlap-save convolution (see 'UniformPartitionedConvolution') on an OpenCL device,
+   * using the kernels of vector_convolution_tail.cl.
+   *
+   * The last 2B input samples, the spectra of the partitions of the impulse response, the frequency-domain delay line
+   * (a ring of spectra) and the spectrum of the output stay on the device: for every block, the host writes
+   * the B new input samples, enqueues the forward fft, the multiply-add of all the partitions (in a single kernel)
+   * and the inverse fft, and reads the B output samples.
+   *
+   * The spectra are hermitian, so only B bins are stored and multiplied (see vector_convolution_tail.cl).
+   *
+   * With 'setFusedKernel(true)', the 3 kernels are replaced by a single kernel: the spectrum of the input
+   * and the spectrum of the output stay in local memory, but the multiply-add is done by a single workgroup.
+   *
+   * The ffts are computed in the local memory of a single workgroup, which limits the block size, see 'maxBlockSize'.
+   */
+  struct OpenCLUniformPartitionedConvolution {
+    static constexpr auto kernel_file = "vector_convolution_tail.cl";
+
+    OpenCLUniformPartitionedConvolution(cl_context context, cl_device_id device)
+    : context(context)
+    , device(device)
+    {
+      cl_int ret;
+      queue = clCreateCommandQueue(context, device, 0, &ret);
+      CHECK_CL_ERROR(ret);
+    }
+
+    ~OpenCLUniformPartitionedConvolution() {
+      release();
+      cl_int ret = clReleaseCommandQueue(queue);
+      CHECK_CL_ERROR(ret);
+    }
+
+    // The ffts of size 2B use 2 buffers of 2B complex numbers in local memory.
+    static unsigned int maxBlockSize(cl_device_id device) {
+      cl_ulong local_mem_sz;
+      cl_int ret = clGetDeviceInfo(device,
+                                   CL_DEVICE_LOCAL_MEM_SIZE,
+                                   sizeof(local_mem_sz), &local_mem_sz, NULL);
+      CHECK_CL_ERROR(ret);
+      unsigned int block_size = 1;
+      while(2 * (4 * block_size) * sizeof(std::complex<float>) <= local_mem_sz) {
+        block_size *= 2;
+      }
+      return block_size;
+    }
+
+    // Effective at the next 'setup'.
+    void setFusedKernel(bool b) { fused_next = b; }
+    bool isFusedKernel() const { return fused; }
+
+    // 'block_size' is a power of two, >= 2 and <= 'maxBlockSize'.
+    void setup(float const * impulse_response,
+               unsigned int const ir_size,
+               unsigned int const block_size) {
+      using namespace imajuscule::fft;
+      verify(is_power_of_two(block_size) && block_size >= 2);
+      verify(block_size <= maxBlockSize(device));
+      release();
+
+      B = block_size;
+      fused = fused_next;
+      unsigned int const N = 2*B;
+      n_partitions = std::max(1u, (ir_size + B - 1) / B);
+      head = 0;
+      newest = 0;
+
+      // the packed spectra of the partitions
+      std::vector<std::complex<float>> ir_spectra(n_partitions * B);
+      {
+        std::vector<float> window(N);
+        Algo_<imj::Tag, float> algo(Contexts_<imj::Tag, float>::getInstance().getBySize(N));
+        typename RealFBins_<imj::Tag, float>::type half(B+1);
+        // the scale of the inverse fft is compensated in the spectra of the partitions.
+        float const scale = 1.f / N;
+        for(unsigned int p=0; p<n_partitions; ++p) {
+          std::fill(window.begin(), window.end(), 0.f);
+          for(unsigned int i=p*B; i<std::min(ir_size, (p+1)*B); ++i) {
+            window[i - p*B] = impulse_response[i] * scale;
+          }
+          algo.forward_real(window.data(), half, N);
+          auto * const spectrum = &ir_spectra[p * B];
+          std::copy(half.begin(), half.begin() + B, spectrum);
+          // the bins 0 and B are real
+          spectrum[0] = {half[0].real(), half[B].real()};
+        }
+      }
+
+      buildKernels(N);
+
+      cl_int ret;
+      auto const spectrum_size = B * sizeof(std::complex<float>);
+      input_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, N * sizeof(float), NULL, &ret);
+      CHECK_CL_ERROR(ret);
+      ir_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, n_partitions * spectrum_size, ir_spectra.data(), &ret);
+      CHECK_CL_ERROR(ret);
+      fdl_mem = clCreateBuffer(context, CL_MEM_READ_WRITE, n_partitions * spectrum_size, NULL, &ret);
+      CHECK_CL_ERROR(ret);
+      accum_mem = clCreateBuffer(context, CL_MEM_READ_WRITE, spectrum_size, NULL, &ret);
+      CHECK_CL_ERROR(ret);
+      output_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY, B * sizeof(float), NULL, &ret);
+      CHECK_CL_ERROR(ret);
+
+      // the input and the delay line are initially silent
+      float const zero = 0.f;
+      ret = clEnqueueFillBuffer(queue, input_mem, &zero, sizeof(zero), 0, N * sizeof(float), 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+      ret = clEnqueueFillBuffer(queue, fdl_mem, &zero, sizeof(zero), 0, n_partitions * spectrum_size, 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+
+      int const n = n_partitions;
+      ret = clSetKernelArg(fft_forward.get(), 0, sizeof(cl_mem), &input_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(fft_forward.get(), 1, sizeof(cl_mem), &fdl_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(fft_forward.get(), 4, 2 * N * sizeof(std::complex<float>), NULL); // local memory
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(multiply_add.get(), 0, sizeof(cl_mem), &fdl_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(multiply_add.get(), 1, sizeof(cl_mem), &ir_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(multiply_add.get(), 2, sizeof(cl_mem), &accum_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(multiply_add.get(), 4, sizeof(int), &n);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(fft_inverse.get(), 0, sizeof(cl_mem), &accum_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(fft_inverse.get(), 1, sizeof(cl_mem), &output_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(fft_inverse.get(), 2, 2 * N * sizeof(std::complex<float>), NULL); // local memory
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 0, sizeof(cl_mem), &input_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 1, sizeof(cl_mem), &fdl_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 2, sizeof(cl_mem), &ir_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 3, sizeof(cl_mem), &output_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 6, sizeof(int), &n);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(convolve.get(), 7, 2 * N * sizeof(std::complex<float>), NULL); // local memory
+      CHECK_CL_ERROR(ret);
+      ret = clFinish(queue);
+      CHECK_CL_ERROR(ret);
+    }
+
+    unsigned int getBlockSize() const { return B; }
+    unsigned int countPartitions() const { return n_partitions; }
+
+    // Replaces the 'getBlockSize()' samples of 'block' by the next output samples.
+    void process(float * block) {
+      head = (head ? head : n_partitions) - 1;
+      int const slot = head;
+      // the new block overwrites the oldest one
+      newest = 1 - newest;
+      int const oldest = (1 - newest) * B;
+
+      // 'block' is not modified before the write is complete,
+      // because the blocking read of the output comes after it (the queue is in-order).
+      cl_int ret = clEnqueueWriteBuffer(queue, input_mem, CL_FALSE, newest * B * sizeof(float), B * sizeof(float), block, 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+
+      if(fused) {
+        ret = clSetKernelArg(convolve.get(), 4, sizeof(int), &slot);
+        CHECK_CL_ERROR(ret);
+        ret = clSetKernelArg(convolve.get(), 5, sizeof(int), &oldest);
+        CHECK_CL_ERROR(ret);
+        ret = clEnqueueNDRangeKernel(queue, convolve.get(), 1, NULL, &fft_item_size, &fft_item_size, 0, NULL, NULL);
+        CHECK_CL_ERROR(ret);
+      }
+      else {
+        ret = clSetKernelArg(fft_forward.get(), 2, sizeof(int), &slot);
+        CHECK_CL_ERROR(ret);
+        ret = clSetKernelArg(fft_forward.get(), 3, sizeof(int), &oldest);
+        CHECK_CL_ERROR(ret);
+        ret = clEnqueueNDRangeKernel(queue, fft_forward.get(), 1, NULL, &fft_item_size, &fft_item_size, 0, NULL, NULL);
+        CHECK_CL_ERROR(ret);
+
+        size_t const n_bins = B;
+        ret = clSetKernelArg(multiply_add.get(), 3, sizeof(int), &slot);
+        CHECK_CL_ERROR(ret);
+        ret = clEnqueueNDRangeKernel(queue, multiply_add.get(), 1, NULL, &n_bins, NULL, 0, NULL, NULL);
+        CHECK_CL_ERROR(ret);
+
+        ret = clEnqueueNDRangeKernel(queue, fft_inverse.get(), 1, NULL, &fft_item_size, &fft_item_size, 0, NULL, NULL);
+        CHECK_CL_ERROR(ret);
+      }
+
+      ret = clEnqueueReadBuffer(queue, output_mem, CL_TRUE, 0, B * sizeof(float), block, 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+    }
+
+  private:
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue queue;
+
+    KernelRegistry::Kernel fft_forward, multiply_add, fft_inverse, convolve;
+    // the number of work items of the fft kernels (a single workgroup)
+    size_t fft_item_size = 0;
+
+    cl_mem input_mem = 0;
+    cl_mem ir_mem = 0;
+    cl_mem fdl_mem = 0;
+    cl_mem accum_mem = 0;
+    cl_mem output_mem = 0;
+
+    bool fused_next = false;
+    bool fused = false;
+    unsigned int B = 0;
+    unsigned int n_partitions = 0;
+    // the newest spectrum of the delay line
+    unsigned int head = 0;
+    // the half of 'input_mem' that has the newest input block
+    unsigned int newest = 0;
+
+    // (the convolutions of the same block size share the program, see 'KernelRegistry')
+    void buildKernels(unsigned int const N) {
+      unsigned int const nButterflies = N/2;
+      for(unsigned int nButterfliesPerThread = 1;;) {
+        auto const variant = fftVariant(kernel_file, nButterflies, nButterfliesPerThread);
+        auto & registry = KernelRegistry::getInstance();
+        fft_forward = registry.get(context, device, variant, "fft_forward");
+        multiply_add = registry.get(context, device, variant, "multiply_add");
+        fft_inverse = registry.get(context, device, variant, "fft_inverse");
+        convolve = registry.get(context, device, variant, "convolve");
+
+        size_t workgroup_max_sz = std::numeric_limits<size_t>::max();
+        for(auto k : {&fft_forward, &fft_inverse, &convolve}) {
+          workgroup_max_sz = std::min(workgroup_max_sz, k->getWorkGroupMaxSize());
+        }
+        if(nButterflies > nButterfliesPerThread * workgroup_max_sz) {
+          // we make the reasonnable assumption that "work group max size"
+          // won't be bigger if we increase 'nButterfliesPerThread':
+          while(nButterflies > nButterfliesPerThread * workgroup_max_sz) {
+            nButterfliesPerThread *= 2;
+          }
+          continue;
+        }
+        fft_item_size = nButterflies / nButterfliesPerThread;
+        break;
+      }
+    }
+
+    void releaseKernels() {
+      for(auto * k : {&fft_forward, &multiply_add, &fft_inverse, &convolve}) {
+        k->reset();
+      }
+    }
+
+    void release() {
+      releaseKernels();
+      for(auto * m : {&input_mem, &ir_mem, &fdl_mem, &accum_mem, &output_mem}) {
+        if(*m) {
+          cl_int ret = clReleaseMemObject(*m);
+          CHECK_CL_ERROR(ret);
+          *m = 0;
+        }
+      }
+    }
+
+    OpenCLUniformPartitionedConvolution(const OpenCLUniformPartitionedConvolution&) = delete;
+    OpenCLUniformPartitionedConvolution& operator=(const OpenCLUniformPartitionedConvolution&) = delete;
+    OpenCLUniformPartitionedConvolution(OpenCLUniformPartitionedConvolution&&) = delete;
+    OpenCLUniformPartitionedConvolution& operator=(OpenCLUniformPartitionedConvolution&&) = delete;
+  };
+
+  /*
+   * Returns a factory for 'NonUniformPartitionedConvolution<float>::setTailFactory',
+   * so that tail sizes are convolved on the OpenCL device (the block sizes must be <= 'maxBlockSize'),
+   * with the fused kernel if 'fused' is true (see 'OpenCLUniformPartitionedConvolution::setFusedKernel').
+   *
+   * 'context' and 'device' must outlive the convolutions.
+   */
+  inline auto makeOpenCLTailFactory(cl_context context, cl_device_id device, bool fused = false) {
+    return [context, device, fused](float const * ir, unsigned int ir_size, unsigned int block_size) {
+      auto c = std::make_shared<OpenCLUniformPartitionedConvolution>(context, device);
+      c->setFusedKernel(fused);
+      c->setup(ir, ir_size, block_size);
+      return [c](float * block) { c->process(block); };
+    };
+  }
+
+} // NS imajuscule
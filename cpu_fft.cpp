@@ -30,8 +30,10 @@ namespace imajuscule {
     template<typename TAG, typename T>
     struct ScopedContext_ {
       using CTXT = Context_<TAG, T>;
-      ScopedContext_(int size) :
-      ctxt(CTXT::create(size) )
+      // 'args' are forwarded to the creation of the context (e.g. the twiddles storage)
+      template<typename... Args>
+      ScopedContext_(int size, Args... args) :
+      ctxt(CTXT::create(size, args...) )
       {}
       
       ~ScopedContext_() {
@@ -42,6 +44,23 @@ namespace imajuscule {
       auto get() const { return ctxt; }
     };
     
+    /*
+     * Process-wide cache of contexts, shared by all threads.
+     *
+     * A context is created the first time its size is requested, and is then immutable
+     * until the end of the process: getting a context that exists is lock-free
+     * (one acquire load), only the creation of a context takes a lock.
+     *
+     * The roots of unity of size N/2 are every other root of unity of size N,
+     * so all contexts share the roots of the largest size requested so far (the "master" table),
+     * with a size-dependent stride. A new master table is created only when a larger size is requested,
+     * hence requesting the largest size first (which 'prewarm' does) results in a single table.
+     *
+     * Contexts of other sizes have their own tables, and are found in a list.
+     *
+     * To avoid the latency of creating contexts on a realtime thread,
+     * call 'prewarm' at startup with the sizes that will be used.
+     */
     template<typename TAG, typename T>
     struct Contexts_ {
       using Context  = Context_<TAG, T>;
@@ -49,37 +68,118 @@ namespace imajuscule {
       
       static Contexts_ & getInstance() {
         // ok to have static variable in header because class is templated
-        // (cf. test ThreadLocal)
-        thread_local Contexts_ ctxt;
+        static Contexts_ ctxt;
         
         return ctxt;
       }
       
       ContextT getBySize(int size) {
         assert(size > 0);
-        assert(is_power_of_two(size));
-        auto index = power_of_two_exponent(size);
-        if(index >= contexts.size()) {
-          contexts.resize(index+1);
+        if(!is_power_of_two(size)) {
+          return getOther(size);
+        }
+        auto & slot = slots[power_of_two_exponent(size)];
+        if(!slot.ready.load(std::memory_order_acquire)) {
+          create(slot, size);
+        }
+        return slot.context;
+      }
+      
+      // Creates the contexts of 'sizes' (a range of sizes), if they don't exist yet.
+      template<typename SIZES>
+      void prewarm(SIZES const & sizes) {
+        // the largest power of two first, so that all powers of two share its table.
+        int largest = 0;
+        for(auto size : sizes) {
+          if(is_power_of_two(size)) {
+            largest = std::max(largest, static_cast<int>(size));
+          }
+        }
+        if(largest) {
+          getBySize(largest);
         }
-        auto & ret = contexts[index];
-        if(!ret) {
-          ret = Context::create(size);
+        for(auto size : sizes) {
+          getBySize(size);
         }
-        return ret;
       }
+      
+      void prewarm(std::initializer_list<int> sizes) {
+        prewarm<std::initializer_list<int>>(sizes);
+      }
+      
     private:
-      Contexts_() {
-        contexts.resize(20);
+      struct Slot {
+        std::atomic<bool> ready{false};
+        ContextT context;
+      };
+      
+      // one slot per power of two
+      std::array<Slot, 8*sizeof(int)> slots;
+      std::mutex creation_mutex;
+      
+      // contexts of sizes that are not powers of two.
+      // Nodes are only added (at the front), so the list can be read without lock.
+      struct Node {
+        int size;
+        ContextT context;
+        Node const * next;
+      };
+      std::atomic<Node const *> others{nullptr};
+      
+      static Node const * find(Node const * n, int size) {
+        for(; n; n = n->next) {
+          if(n->size == size) {
+            return n;
+          }
+        }
+        return nullptr;
+      }
+      
+      ContextT getOther(int size) {
+        if(auto n = find(others.load(std::memory_order_acquire), size)) {
+          return n->context;
+        }
+        std::lock_guard<std::mutex> l(creation_mutex);
+        auto const head = others.load(std::memory_order_relaxed);
+        if(auto n = find(head, size)) {
+          // created by another thread in the meantime
+          return n->context;
+        }
+        auto n = new Node{size, Context::create(size), head};
+        others.store(n, std::memory_order_release);
+        return n->context;
       }
+      
+      // the master tables, by increasing size (the last one is the current one).
+      // Former master tables are kept alive because some contexts refer to them.
+      std::vector<std::pair<ContextT, int>> masters;
+      
+      void create(Slot & slot, int size) {
+        std::lock_guard<std::mutex> l(creation_mutex);
+        if(slot.ready.load(std::memory_order_relaxed)) {
+          // created by another thread in the meantime
+          return;
+        }
+        if(masters.empty() || masters.back().second < size) {
+          masters.emplace_back(Context::create(size), size);
+        }
+        auto const & master = masters.back();
+        slot.context = Context::share(master.first, master.second, size);
+        slot.ready.store(true, std::memory_order_release);
+      }
+      
+      Contexts_() = default;
       ~Contexts_() {
-        for(auto const &c:contexts) {
-          if(c) {
-            Context::destroy(c);
-          }
+        for(auto const &m:masters) {
+          Context::destroy(m.first);
+        }
+        for(auto n = others.load(); n;) {
+          auto next = n->next;
+          Context::destroy(n->context);
+          delete n;
+          n = next;
         }
       }
-      std::vector<ContextT> contexts;
       
       Contexts_(const Contexts_&) = delete;
       Contexts_(Contexts_&&) = delete;
@@ -122,9 +222,43 @@ namespace imajuscule {
   }
   
 
+  /*
+   * exp(-2 i pi index / size)
+   *
+   * The angle is reduced to the first octant with exact integer arithmetic, and the sine and cosine
+   * are computed in extended precision, so that the roots are accurate to the last bit
+   * of a double, and have the exact symmetries of the roots of unity.
+   */
   template<typename T>
   static std::complex<T> make_root_of_unity(unsigned int index, unsigned int size) {
-    return std::polar(1.f, -2 * static_cast<T>(M_PI) * index / size);
+    using Extended = long double;
+    constexpr Extended pi = 3.141592653589793238462643383279502884L;
+    
+    // the angle is 2 pi 'eighths' / (8*size)
+    uint64_t const S = size;
+    uint64_t eighths = 8 * (index % size);
+    bool const conjugate = eighths > 4*S; // angle in ]pi, 2pi[
+    if(conjugate) {
+      eighths = 8*S - eighths;
+    }
+    bool const negate_cos = eighths > 2*S; // angle in ]pi/2, pi]
+    if(negate_cos) {
+      eighths = 4*S - eighths;
+    }
+    bool const swap = eighths > S; // angle in ]pi/4, pi/2]
+    if(swap) {
+      eighths = 2*S - eighths;
+    }
+    Extended const angle = pi * static_cast<Extended>(eighths) / static_cast<Extended>(4*S);
+    Extended c = std::cos(angle);
+    Extended s = std::sin(angle);
+    if(swap) {
+      std::swap(c, s);
+    }
+    if(negate_cos) {
+      c = -c;
+    }
+    return {static_cast<T>(c), static_cast<T>(conjugate ? s : -s)};
   }
   
   template<typename T>
@@ -142,6 +276,50 @@ namespace imajuscule {
     compute_roots_of_unity(N, res);
     return std::move(res);
   }
+  
+  // All the roots of unity (for sizes that are not powers of two)
+  template<typename T>
+  void compute_all_roots_of_unity(unsigned int N, std::vector<std::complex<T>> & res) {
+    res.reserve(N);
+    for(unsigned int i=0; i<N; ++i) {
+      res.push_back(make_root_of_unity<T>(i,N));
+    }
+  }
+  
+  // The roots of unity of index in [0, N/8] (the first octant), from which all others can be deduced,
+  // see 'octant_root_of_unity'.
+  template<typename T>
+  void compute_octant_roots_of_unity(unsigned int N, std::vector<std::complex<T>> & res) {
+    auto n_roots = N/8 + 1;
+    res.reserve(n_roots);
+    for(unsigned int i=0; i<n_roots; ++i) {
+      res.push_back(make_root_of_unity<T>(i,N));
+    }
+  }
+  
+  // Root of unity of index 'k' in [0, N/2), from the roots of the first octant.
+  template<typename T>
+  std::complex<T> octant_root_of_unity(std::complex<T> const * octant, unsigned int N, unsigned int k) {
+    unsigned int const quarter = N/4;
+    // root[k + N/4] = -i * root[k]
+    bool const rotate = quarter && (k >= quarter);
+    if(rotate) {
+      k -= quarter;
+    }
+    std::complex<T> w;
+    if(k <= N/8) {
+      w = octant[k];
+    }
+    else {
+      // root[N/4 - k] = -i * conj(root[k])
+      auto const c = octant[quarter - k];
+      w = {-c.imag(), -c.real()};
+    }
+    if(rotate) {
+      return {w.imag(), -w.real()};
+    }
+    return w;
+  }
 
   
   namespace fft {
@@ -211,13 +389,8 @@ namespace imajuscule {
       }
       
       static void mult_assign(type & v, type const & w) {
-        auto * __restrict it = v.begin().base();
-        auto * __restrict end = v.end().base();
-        
-        auto * __restrict it_w = w.begin().base();
-        for(; it != end; ++it, ++it_w) {
-          *it *= *it_w;
-        }
+        assert(w.size() >= v.size());
+        simd::bestSpectrumKernels<T>().multiply(v.data(), w.data(), v.size());
       }
       
       static void zero(type & v) {
@@ -226,17 +399,24 @@ namespace imajuscule {
       }
       
       static void multiply_add(type & accum, type const & m1, type const & m2) {
-        auto * __restrict it_accum = accum.begin().base();
-        auto * __restrict it1 = m1.begin().base();
-        auto * __restrict it2 = m2.begin().base();
-        
-        for(auto * __restrict end1 = m1.end().base();
-            it1 != end1;
-            ++it2, ++it1, ++it_accum)
-        {
-          assert(it_accum < accum.end().base());
-          *it_accum += *it1 * *it2;
-        }
+        assert(accum.size() >= m1.size());
+        assert(m2.size() >= m1.size());
+        std::complex<T> const * a = m1.data();
+        std::complex<T> const * b = m2.data();
+        simd::bestSpectrumKernels<T>().multiply_add(accum.data(), &a, &b, 1, m1.size());
+      }
+      
+      /*
+       * accum += m1[0] * m2[0] + ... + m1[K-1] * m2[K-1], where m1[k] and m2[k] point to accum.size() elements.
+       *
+       * The products are accumulated in registers, so 'accum' is read and written once,
+       * instead of once per product when calling the other overload K times.
+       */
+      static void multiply_add(type & accum,
+                               std::complex<T> const * const * m1,
+                               std::complex<T> const * const * m2,
+                               unsigned int const K) {
+        simd::bestSpectrumKernels<T>().multiply_add(accum.data(), m1, m2, K, accum.size());
       }
       
       static std::pair<int, T> getMaxSquaredAmplitude(type const & v) {
@@ -259,12 +439,59 @@ namespace imajuscule {
       }
     };
     
+    // How the roots of unity are stored in a context
+    enum class Twiddles {
+      // N/2 roots
+      Full,
+      // N/8+1 roots (the first octant), the others are deduced with sign and real / imaginary swaps:
+      // for huge memory-bound ffts, the working set is smaller at the cost of a few more operations.
+      Octant
+    };
+    
+    // Odd radices of the mixed-radix fft (the power of two part uses the radix-2 / radix-4 fft)
+    constexpr std::array<unsigned int, 3> mixed_radices{{3, 5, 7}};
+    
+    // true when the fft of size N can be computed with the mixed-radix fft
+    constexpr bool is_mixed_radix_size(unsigned int N) {
+      if(!N) {
+        return false;
+      }
+      while(N % 2 == 0) {
+        N /= 2;
+      }
+      for(auto radix : mixed_radices) {
+        while(N % radix == 0) {
+          N /= radix;
+        }
+      }
+      return N == 1;
+    }
+    
+    constexpr unsigned int ceil_power_of_two(unsigned int N) {
+      unsigned int p = 1;
+      while(p < N) {
+        p *= 2;
+      }
+      return p;
+    }
+    
+    template<typename T>
+    struct Bluestein;
+    
     template<typename T>
     struct ImjContext {
       using vec_roots = std::vector<std::complex<T>>;
       
       ImjContext() : roots(nullptr) {}
-      ImjContext(vec_roots * roots) : roots(roots) {}
+      ImjContext(vec_roots * roots,
+                 unsigned int table_size,
+                 Twiddles twiddles = Twiddles::Full,
+                 unsigned int stride = 1)
+      : roots(roots)
+      , table_size(table_size)
+      , twiddles(twiddles)
+      , stride(stride)
+      {}
       
       operator bool() const {
         return !empty();
@@ -274,8 +501,47 @@ namespace imajuscule {
       
       vec_roots * getRoots() const { return roots; }
       vec_roots * editRoots() { return roots; }
+      
+      // distance between consecutive roots of unity of the context size in 'getRoots()'
+      unsigned int getStride() const { return stride; }
+      
+      // the size of the fft whose roots of unity are in 'getRoots()'
+      unsigned int getTableSize() const { return table_size; }
+      
+      Twiddles getTwiddles() const { return twiddles; }
+      
+      // Bluestein data for an fft of size N, if the context has some
+      Bluestein<T> const * getBluestein(unsigned int N) const {
+        for(auto b : bluestein) {
+          if(b && b->N == N) {
+            return b;
+          }
+        }
+        return nullptr;
+      }
+      
+      void setBluestein(std::array<Bluestein<T> const *, 2> b) {
+        bluestein = b;
+      }
+      std::array<Bluestein<T> const *, 2> const & getBluesteins() const {
+        return bluestein;
+      }
+      
+      // Root of unity of index 'k' in [0, N/2) of the context size N
+      std::complex<T> getRoot(unsigned int k) const {
+        if(twiddles == Twiddles::Octant) {
+          return octant_root_of_unity(roots->data(), table_size, k*stride);
+        }
+        return (*roots)[k*stride];
+      }
     private:
       vec_roots * roots;
+      unsigned int table_size = 0;
+      Twiddles twiddles = Twiddles::Full;
+      unsigned int stride = 1;
+      // For sizes that have prime factors that are not in 'mixed_radices' :
+      // the data of the ffts of size N and N/2 (used by real ffts).
+      std::array<Bluestein<T> const *, 2> bluestein{{nullptr, nullptr}};
     };
     
     template<typename T>
@@ -283,13 +549,46 @@ namespace imajuscule {
       using type = ImjContext<T>;
       using InnerCtxt = typename type::vec_roots;
       
-      static auto create(int size) {
+      // For sizes that are not powers of two, all the roots of unity are computed
+      // (the octant storage is not supported).
+      static auto create(int size, Twiddles twiddles = Twiddles::Full) {
         auto pv = new InnerCtxt();
-        compute_roots_of_unity(size, *pv);
-        return type(pv);
+        if(!is_power_of_two(size)) {
+          compute_all_roots_of_unity(size, *pv);
+          type c(pv, size);
+          std::array<Bluestein<T> const *, 2> b{{nullptr, nullptr}};
+          if(!is_mixed_radix_size(size)) {
+            b[0] = new Bluestein<T>(size);
+            if(size % 2 == 0) {
+              b[1] = new Bluestein<T>(size/2);
+            }
+          }
+          c.setBluestein(b);
+          return c;
+        }
+        if(twiddles == Twiddles::Octant) {
+          compute_octant_roots_of_unity(size, *pv);
+        }
+        else {
+          compute_roots_of_unity(size, *pv);
+        }
+        return type(pv, size, twiddles);
+      }
+      
+      // A context of size 'size' using the roots of 'master' (of size 'master_size', a multiple of 'size').
+      // It is valid as long as 'master' is, and must not be destroyed.
+      static type share(type master, int master_size, int size) {
+        assert(master_size % size == 0);
+        return type(master.editRoots(),
+                    master.getTableSize(),
+                    master.getTwiddles(),
+                    master.getStride() * (master_size / size));
       }
       
       static void destroy(type c) {
+        for(auto b : c.getBluesteins()) {
+          delete b;
+        }
         delete c.editRoots();
       }
     };
@@ -301,56 +600,534 @@ namespace imajuscule {
       INVERSE
     };
     
+    /*
+     * Iterative radix-2 decimation in time fft (replaces the recursive implementation
+     * which used one function call per input element and read the input with a stride
+     * that doubled at every level):
+     *
+     * - Sizes up to 'leaf_size' (up to codelet::max_size in place) are computed by a codelet (see cpu_fft_codelets.cpp):
+     *   bigger codelets are slower than leaves followed by the vectorized levels.
+     * - Otherwise, the input is read in bit-reversed order by codelets of size 'leaf_size',
+     *   which compute the first levels before the first write to 'result'.
+     * - The next levels, as long as a butterfly group fits in 'cache_block_size' elements,
+     *   are computed block by block ("depth first"), so that a block stays in cache
+     *   while all its levels are computed.
+     * - The remaining levels are computed one at a time over the whole result ("breadth first").
+     *
+     * Levels are computed by 'kernels', which are vectorized for the cpu (see cpu_fft_simd.cpp).
+     *
+     * 'run_inplace' computes the fft in the input buffer, to halve the memory used by huge ffts:
+     * the input is bit-reversed by swapping elements in place, then the levels are computed as above.
+     *
+     * When 'root' holds only the first octant of the roots of unity (see Twiddles::Octant),
+     * the twiddle factors of a level are rebuilt by chunks of 'twiddle_chunk_size' in a buffer on the stack.
+     */
     template<FftType TYPE, typename T>
     struct TukeyCooley {
-      std::complex<T> * const root;
+      // 2^12 complex<float> = 32 KB
+      static constexpr unsigned int cache_block_size = 4096;
+      static constexpr unsigned int twiddle_chunk_size = 256;
+      // size of the codelets computing the first levels
+      static constexpr unsigned int leaf_size = 16;
+      static_assert(leaf_size <= codelet::max_size);
+
+      std::complex<T> const * const root;
+      simd::LevelKernels<T> const & kernels;
+      // distance between consecutive roots of unity of the fft size in 'root':
+      // 'root' can be the roots of unity of a multiple of the fft size.
+      unsigned int const root_stride = 1;
+      // when not null, the levels are split in tasks of at least 'grain' elements,
+      // run by the threads of the pool.
+      WorkStealingPool * const pool = nullptr;
+      unsigned int const grain = 0;
+      // true when 'root' holds only the first octant of the roots of unity
+      bool const octant = false;
       
-      // N is 'result' size
+      // N is 'result' size, the input elements are 'input_stride' apart
       void run(std::complex<T> const * const __restrict input,
                std::complex<T> * __restrict result,
-               unsigned int const N) const {
-        tukeyCooley(input, result, N/2, 1);
+               unsigned int const N,
+               unsigned int const input_stride = 1) const {
+        if(N <= leaf_size) {
+          codelet::run<conjugate_input>(input, input_stride, result, N);
+          return;
+        }
+        if(parallel(N)) {
+          pool->parallel_for(0, N/leaf_size, grain/leaf_size, [=](unsigned int b, unsigned int e) {
+            leaves(input, input_stride, result, N, b, e);
+          });
+        }
+        else {
+          leaves(input, input_stride, result, N, 0, N/leaf_size);
+        }
+        upper_levels(result, N);
+      }
+      
+      // 'data' has N elements, and is replaced by its fft.
+      void run_inplace(std::complex<T> * __restrict data,
+                       unsigned int const N) const {
+        // (the bit reversal by tiles needs N >= bit_reverse_tile^2)
+        if(N <= codelet::max_size) {
+          codelet::run<conjugate_input>(data, 1, data, N);
+          return;
+        }
+        if(parallel(N)) {
+          // the swaps of different tiles are independent.
+          unsigned int const tile_sz = bit_reverse_tile * bit_reverse_tile;
+          pool->parallel_for(0, N/tile_sz, std::max(1u, grain/tile_sz), [=](unsigned int b, unsigned int e) {
+            bit_reverse_inplace(data, N, b, e);
+          });
+          pool->parallel_for(0, N/leaf_size, grain/leaf_size, [=](unsigned int b, unsigned int e) {
+            leaves_inplace(data, b, e);
+          });
+        }
+        else {
+          bit_reverse_inplace(data, N, 0, N/(bit_reverse_tile * bit_reverse_tile));
+          leaves_inplace(data, 0, N/leaf_size);
+        }
+        upper_levels(data, N);
       }
     private:
+      static constexpr bool conjugate_input = (TYPE == FftType::INVERSE);
       
-      void tukeyCooley(std::complex<T> const * const __restrict it,
-                       std::complex<T> * __restrict result,
-                       unsigned int const N,
-                       unsigned int const stride) const {
-        if(N==0) {
-          if constexpr (TYPE == FftType::FORWARD) {
-            *result = *it;
+      bool parallel(unsigned int const N) const {
+        return pool && N >= 2*grain;
+      }
+      
+      // Computes the levels following the first two levels.
+      void upper_levels(std::complex<T> * __restrict result,
+                        unsigned int const N) const {
+        unsigned int const block_size = std::min(N, cache_block_size);
+        if(!parallel(N)) {
+          for(unsigned int block = 0; block < N; block += block_size) {
+            levels(result + block, block_size, leaf_size, block_size, N);
           }
-          else {
-            *result = conj(*it);
+          levels(result, N, block_size, N, N);
+          return;
+        }
+        
+        pool->parallel_for(0, N/block_size, grain/block_size, [=](unsigned int b, unsigned int e) {
+          for(; b != e; ++b) {
+            levels(result + b*block_size, block_size, leaf_size, block_size, N);
+          }
+        });
+        
+        // In these levels, there are few groups of butterflies, so the tasks split
+        // the butterflies of a group.
+        for(unsigned int half = block_size; half < N;) {
+          bool const radix4 = 4*half <= N;
+          unsigned int const group_sz = radix4 ? 4*half : 2*half;
+          // a "butterfly" here processes group_sz/half elements.
+          unsigned int const n_butterflies = (N/group_sz) * half;
+          pool->parallel_for(0, n_butterflies, grain/(group_sz/half), [=](unsigned int b, unsigned int const e) {
+            while(b != e) {
+              unsigned int const group = b / half;
+              unsigned int const j_begin = b - group * half;
+              unsigned int const j_end = std::min(half, j_begin + (e - b));
+              level(radix4, result + group * group_sz, group_sz, half, N, j_begin, j_end);
+              b += j_end - j_begin;
+            }
+          });
+          half = radix4 ? 4*half : 2*half;
+        }
+      }
+      
+      static constexpr unsigned int bit_reverse_tile = 8;
+      static_assert(bit_reverse_tile * bit_reverse_tile <= codelet::max_size);
+      
+      /*
+       * Swaps every element with the element at the bit-reversed index.
+       *
+       * An index is split in (high, middle, low) bits, the high and low parts having 'tile' values.
+       * The elements sharing the middle bits form a tile of tile x tile elements, on 'tile' rows of
+       * 'tile' contiguous elements, and the bit-reversed indices of a tile are in the tile of the
+       * bit-reversed middle bits: the two tiles fit in the L1 cache while their elements are swapped.
+       *
+       * Tiles of index in ['t_begin', 't_end') are swapped with their bit-reversed tile,
+       * when it is not smaller (so that a pair of elements is swapped once).
+       */
+      static void bit_reverse_inplace(std::complex<T> * __restrict data,
+                                      unsigned int const N,
+                                      unsigned int const t_begin,
+                                      unsigned int const t_end) {
+        constexpr unsigned int tile = bit_reverse_tile;
+        constexpr unsigned int tile_bits = power_of_two_exponent(tile);
+        // bit-reversed indices in [0, tile)
+        constexpr unsigned int reversed[tile] = {0, 4, 2, 6, 1, 5, 3, 7};
+        unsigned int const n_tiles = N / (tile * tile);
+        unsigned int const high_shift = power_of_two_exponent(N) - tile_bits;
+        for(unsigned int t = t_begin; t < t_end; ++t) {
+          unsigned int const rt = (n_tiles == 1) ? 0 : (reverseBits(t) >> (8*sizeof(uint32_t) - power_of_two_exponent(n_tiles)));
+          if(rt < t) {
+            continue;
+          }
+          for(unsigned int high = 0; high < tile; ++high) {
+            unsigned int const row = (high << high_shift) + (t << tile_bits);
+            unsigned int const reversed_row = (rt << tile_bits) + reversed[high];
+            for(unsigned int low = 0; low < tile; ++low) {
+              unsigned int const i = row + low;
+              unsigned int const r = reversed_row + (reversed[low] << high_shift);
+              if(rt != t || r > i) {
+                std::swap(data[i], data[r]);
+              }
+            }
           }
+        }
+      }
+      
+      // Computes the leaves of index in ['m_begin', 'm_end'): leaf m is the fft of the 'leaf_size' elements
+      // of the input that are N/'leaf_size' apart, starting at the bit-reversed index of m.
+      static void leaves(std::complex<T> const * const __restrict input,
+                         unsigned int const input_stride,
+                         std::complex<T> * __restrict result,
+                         unsigned int const N,
+                         unsigned int const m_begin,
+                         unsigned int const m_end) {
+        unsigned int const n_leaves = N/leaf_size;
+        // shift to bit-reverse an index in [0, n_leaves)
+        unsigned int const shift = 8*sizeof(uint32_t) - power_of_two_exponent(n_leaves);
+        
+        for(unsigned int m = m_begin; m < m_end; ++m) {
+          unsigned int const r = reverseBits(m) >> shift;
+          codelet::Codelet<leaf_size, conjugate_input, T>::run(input + r*input_stride, n_leaves*input_stride, result + m*leaf_size);
+        }
+      }
+      
+      // Same as 'leaves', on bit-reversed data.
+      static void leaves_inplace(std::complex<T> * __restrict data,
+                                 unsigned int const m_begin,
+                                 unsigned int const m_end) {
+        for(unsigned int m = m_begin; m < m_end; ++m) {
+          codelet::Codelet<leaf_size, conjugate_input, T>::run_bit_reversed(data + m*leaf_size);
+        }
+      }
+      
+      // Computes the levels where butterflies span 2*'half' elements, for 'half' in ['first_half', 'end_half'),
+      // on 'sz' elements.
+      // Levels are computed two by two (radix-4) to halve the number of passes over the data.
+      void levels(std::complex<T> * __restrict result,
+                  unsigned int const sz,
+                  unsigned int half,
+                  unsigned int const end_half,
+                  unsigned int const N) const {
+        for(; 2*half < end_half; half <<= 2) {
+          level(true, result, sz, half, N, 0, half);
+        }
+        if(half < end_half) {
+          level(false, result, sz, half, N, 0, half);
+        }
+      }
+      
+      // Computes the butterflies of index in ['j_begin', 'j_end') of a radix-2 or radix-4 level
+      void level(bool const radix4,
+                 std::complex<T> * __restrict result,
+                 unsigned int const sz,
+                 unsigned int const half,
+                 unsigned int const N,
+                 unsigned int const j_begin,
+                 unsigned int const j_end) const {
+        unsigned int const stride = root_stride*(N/(2*half));
+        if(!octant) {
+          (radix4 ? kernels.radix4 : kernels.radix2)(result, sz, half, root, stride, j_begin, j_end);
           return;
         }
-
-        // radix-2
         
-        auto const double_stride = 2*stride;
-        auto const half_N = N/2;
-        // computes first half of result
-        // using input with offset 0
-        tukeyCooley(it         , result , half_N, double_stride );
-        auto * __restrict result2 = result + N;
-        // computes second half of result
-        // using input with offset stride
-        tukeyCooley(it + stride, result2, half_N, double_stride );
+        unsigned int const table_size = N*root_stride;
+        // w[0] : twiddles of level 'half', w[1] and w[2] : twiddles of level 2*'half'
+        std::complex<T> w[3][twiddle_chunk_size];
         
-        // full result by mixing the 2 halves
-        std::complex<T> * __restrict root_it = root;
-        for(;result != result2;
-            ++result, root_it += stride)
-        {
-          auto const t = result[N] * *root_it;
-          result[N] = result[0] - t;
-          result[0] += t;
+        for(unsigned int j_chunk = j_begin; j_chunk < j_end; j_chunk += twiddle_chunk_size) {
+          unsigned int const len = std::min(twiddle_chunk_size, j_end - j_chunk);
+          for(unsigned int j=0; j<len; ++j) {
+            w[0][j] = octant_root_of_unity(root, table_size, (j_chunk+j)*stride);
+          }
+          if(!radix4) {
+            kernels.radix2(result + j_chunk, sz, half, w[0], 1, 0, len);
+            continue;
+          }
+          for(unsigned int j=0; j<len; ++j) {
+            auto const w2 = octant_root_of_unity(root, table_size, (j_chunk+j)*(stride/2));
+            w[1][j] = w2;
+            // root[(j+half)*stride/2] = -i * w2
+            w[2][j] = {w2.imag(), -w2.real()};
+          }
+          // The radix-4 butterflies are computed as 2 radix-2 levels, using the twiddles of the chunk.
+          if(len == half) {
+            // the chunk has all the twiddles of the level: the groups are computed level by level.
+            kernels.radix2(result, sz, half, w[0], 1, 0, len);
+            kernels.radix2(result, sz, 2*half, w[1], 1, 0, len);
+            kernels.radix2(result + half, sz, 2*half, w[2], 1, 0, len);
+            continue;
+          }
+          // one group at a time, so that the 4 chunks of the group stay in cache between the 2 levels
+          for(unsigned int group = 0; group < sz; group += 4*half) {
+            auto * const g = result + group + j_chunk;
+            kernels.radix2(g, 4*half, half, w[0], 1, 0, len);
+            kernels.radix2(g, 4*half, 2*half, w[1], 1, 0, len);
+            kernels.radix2(g + half, 4*half, 2*half, w[2], 1, 0, len);
+          }
+        }
+      }
+    };
+    
+    /*
+     * Mixed-radix fft, for sizes N = n * R where n is a power of two and the prime factors of R are in 'mixed_radices'
+     * (Cooley-Tukey decomposition, with N1 = n, N2 = R):
+     *
+     * - the R ffts of size n (on elements R apart, read in place by the leaves) are computed
+     *   by the vectorized power-of-two fft, in the rows of a R x n matrix,
+     * - the matrix is multiplied by the twiddles W_N^(row*column),
+     * - the n interleaved dfts of size R (on the columns of the matrix) are computed by iterative stages
+     *   of odd radices (Stockham autosort, decimation in frequency): a stage of radix P computes dfts of size P
+     *   and writes them in order in another buffer, and the last stage writes the result in natural order.
+     *   The stages are computed by the vectorized odd radix kernels (see 'simd::OddStageKernel').
+     *
+     * It is slower than the fft of the next power of two for sizes close to it, see 'Algo_'.
+     */
+    template<FftType TYPE, typename T>
+    struct MixedRadix {
+      // all the roots of unity of the fft size (every 'root_stride' element)
+      std::complex<T> const * const root;
+      simd::LevelKernels<T> const & kernels;
+      unsigned int const root_stride = 1;
+      
+      // 'scratch' has 2*N elements
+      void run(std::complex<T> const * const __restrict input,
+               std::complex<T> * __restrict result,
+               std::complex<T> * __restrict scratch,
+               unsigned int const N) const {
+        assert(is_mixed_radix_size(N));
+        std::array<unsigned int, 8*sizeof(unsigned int)> radices;
+        unsigned int n_stages = 0;
+        unsigned int R = 1;
+        for(auto radix : mixed_radices) {
+          for(; (N/R) % radix == 0; R *= radix) {
+            radices[n_stages++] = radix;
+          }
+        }
+        unsigned int const n = N/R;
+        // power of two sizes use TukeyCooley
+        assert(n_stages);
+        
+        std::complex<T> const * src = input;
+        if(n > 1) {
+          // TukeyCooley conjugates the input of inverse ffts, hence the stages compute forward dfts.
+          TukeyCooley<TYPE, T> const algo{root, kernels, R*root_stride};
+          for(unsigned int row=0; row<R; ++row) {
+            std::complex<T> * const y = scratch + row*n;
+            algo.run(input + row, y, n, R);
+            for(unsigned int column=1; column<n; ++column) {
+              y[column] *= root[row*column*root_stride];
+            }
+          }
+          src = scratch;
+        }
+        
+        // the stages alternate between 'result' and 'buffer', the last stage writes in 'result'
+        std::complex<T> * const buffer = (n > 1) ? scratch + N : scratch;
+        std::complex<T> * dst = (n_stages % 2) ? result : buffer;
+        for(unsigned int i=0, s=n; i<n_stages; s *= radices[i], ++i) {
+          // when there are no rows, the first stage conjugates the input of inverse ffts
+          bool const conjugate = (i == 0) && (n == 1) && (TYPE == FftType::INVERSE);
+          kernels.odd_stage(radices[i], src, dst, N, s, root, root_stride, conjugate);
+          src = dst;
+          dst = (dst == result) ? buffer : result;
+        }
+      }
+    };
+    
+    /*
+     * Six-step fft (Bailey), for the power of two sizes that don't fit in the cache.
+     *
+     * N = N1 * N2, and the input is seen as a N2 x N1 matrix (x[n1 + N1*n2]):
+     *
+     * - the columns of the input are gathered in the rows of a N1 x N2 matrix in 'result', by blocks
+     *   of 'block' rows (so that every cache line read is entirely used), and while a block is in cache,
+     *   the ffts of size N2 of its rows are computed in place, and multiplied by the twiddles W_N^(n1*k2),
+     * - the matrix is transposed by tiles in 'scratch',
+     * - the ffts of size N1 of the rows of 'scratch' are computed in place by blocks of 'block' rows,
+     *   and every block is transposed in 'result', where X[k2 + N2*k1] is in natural order.
+     *
+     * So the data goes 3 times through the memory, instead of once per level of TukeyCooley
+     * that is computed on the whole result.
+     */
+    template<FftType TYPE, typename T>
+    struct SixStep {
+      // rows gathered / scattered at once: 4 cache lines of complex<float> are read / written per row
+      static constexpr unsigned int block = 32;
+      static constexpr unsigned int transpose_tile = 32;
+      // the twiddles of a row are computed as the products of 2 roots of unity: one of
+      // the 'twiddle_split' first twiddles of the row, and one of their multiples.
+      static constexpr unsigned int twiddle_split = 64;
+      // N1 and N2 must be multiples of 'block' and 'transpose_tile', and N2 >= N1 >= sqrt(N)/sqrt(2).
+      static constexpr unsigned int min_size = transpose_tile * transpose_tile;
+      static_assert(block <= transpose_tile, "");
+      
+      // the roots of unity of the fft size (every 'root_stride' element)
+      std::complex<T> const * const root;
+      simd::LevelKernels<T> const & kernels;
+      unsigned int const root_stride = 1;
+      // when not null, the blocks of rows and the tiles are computed by the threads of the pool.
+      WorkStealingPool * const pool = nullptr;
+      // true when 'root' holds only the first octant of the roots of unity
+      bool const octant = false;
+      
+      // 'scratch' has N elements
+      void run(std::complex<T> const * const __restrict input,
+               std::complex<T> * __restrict result,
+               std::complex<T> * __restrict scratch,
+               unsigned int const N) const {
+        unsigned int const N1 = 1u << (power_of_two_exponent(N)/2);
+        unsigned int const N2 = N/N1;
+        assert(N >= min_size);
+        assert(N1 >= transpose_tile);
+        
+        // For inverse ffts the input is conjugated by the first ffts, so the next ffts are forward ffts.
+        TukeyCooley<TYPE, T> const first{root, kernels, N1*root_stride, nullptr, 0, octant};
+        TukeyCooley<FftType::FORWARD, T> const second{root, kernels, N2*root_stride, nullptr, 0, octant};
+        
+        forEach(N1/block, [=, &first](unsigned int b) {
+          unsigned int const n1 = b*block;
+          std::complex<T> * const y = result + n1*N2;
+          for(unsigned int n2=0; n2<N2; ++n2) {
+            std::complex<T> const * const x = input + n1 + N1*n2;
+            for(unsigned int r=0; r<block; ++r) {
+              y[r*N2 + n2] = x[r];
+            }
+          }
+          for(unsigned int r=0; r<block; ++r) {
+            first.run_inplace(y + r*N2, N2);
+            multiply_twiddles(y + r*N2, n1 + r, N2, N);
+          }
+        });
+        
+        forEach(N1/transpose_tile, [=](unsigned int b) {
+          unsigned int const row = b*transpose_tile;
+          for(unsigned int column = 0; column < N2; column += transpose_tile) {
+            for(unsigned int i=row; i<row+transpose_tile; ++i) {
+              for(unsigned int j=column; j<column+transpose_tile; ++j) {
+                scratch[j*N1 + i] = result[i*N2 + j];
+              }
+            }
+          }
+        });
+        
+        forEach(N2/block, [=, &second](unsigned int b) {
+          unsigned int const k2 = b*block;
+          std::complex<T> * const y = scratch + k2*N1;
+          for(unsigned int r=0; r<block; ++r) {
+            second.run_inplace(y + r*N1, N1);
+          }
+          for(unsigned int k1=0; k1<N1; ++k1) {
+            std::complex<T> * const x = result + k1*N2 + k2;
+            for(unsigned int r=0; r<block; ++r) {
+              x[r] = y[r*N1 + k1];
+            }
+          }
+        });
+      }
+      
+    private:
+      template<typename F>
+      void forEach(unsigned int const count, F const & f) const {
+        if(!pool) {
+          for(unsigned int i=0; i<count; ++i) {
+            f(i);
+          }
+          return;
+        }
+        pool->parallel_for(0, count, 1, [&f](unsigned int b, unsigned int const e) {
+          for(; b != e; ++b) {
+            f(b);
+          }
+        });
+      }
+      
+      // Root of unity of index 'k' in [0, N) of the fft size N
+      std::complex<T> twiddle(unsigned int k, unsigned int const N) const {
+        bool const negate = k >= N/2;
+        if(negate) {
+          // root[k + N/2] = -root[k]
+          k -= N/2;
+        }
+        auto const w = octant ? octant_root_of_unity(root, N*root_stride, k*root_stride) : root[k*root_stride];
+        return negate ? -w : w;
+      }
+      
+      // Multiplies 'row' (of index 'n1') by the twiddles W_N^(n1*k2)
+      void multiply_twiddles(std::complex<T> * __restrict row,
+                             unsigned int const n1,
+                             unsigned int const N2,
+                             unsigned int const N) const {
+        if(!n1) {
+          return;
+        }
+        std::complex<T> low[twiddle_split];
+        unsigned int const n_low = std::min(N2, twiddle_split);
+        for(unsigned int k=0; k<n_low; ++k) {
+          low[k] = twiddle(n1*k, N);
+        }
+        for(unsigned int high = 0; high < N2; high += n_low) {
+          auto const w = twiddle(n1*high, N);
+          std::complex<T> * const r = row + high;
+          for(unsigned int k=0; k<n_low; ++k) {
+            r[k] *= w * low[k];
+          }
         }
       }
     };
     
+    /*
+     * Precomputed data to compute an fft of size N (with large prime factors)
+     * as a convolution with a chirp, using ffts of size M (a power of two >= 2N-1):
+     *
+     * X[k] = chirp[k] * sum_n (x[n] * chirp[n]) * conj(chirp[k-n]), where chirp[n] = exp(-i pi n^2 / N)
+     *
+     * (so it is slower than the fft of the next power of two of N, see 'Algo_')
+     */
+    template<typename T>
+    struct Bluestein {
+      Bluestein(unsigned int N)
+      : N(N)
+      , M(ceil_power_of_two(2*N-1))
+      {
+        compute_roots_of_unity(M, roots);
+        chirp.reserve(N);
+        for(uint64_t n=0; n<N; ++n) {
+          // n^2 is reduced modulo 2N to keep the angle accurate
+          chirp.push_back(make_root_of_unity<T>((n*n) % (2*N), 2*N));
+        }
+        // the fft of the (circular) conjugate chirp, divided by M
+        std::vector<std::complex<T>> c(M, std::complex<T>{0,0});
+        for(unsigned int n=0; n<N; ++n) {
+          c[n] = c[(M-n) % M] = conj(chirp[n]);
+        }
+        filter.resize(M);
+        TukeyCooley<FftType::FORWARD, T>{roots.data(), simd::bestLevelKernels<T>()}.run(c.data(), filter.data(), M);
+        for(auto & f : filter) {
+          f /= static_cast<T>(M);
+        }
+      }
+      
+      unsigned int const N, M;
+      // roots of unity of M
+      std::vector<std::complex<T>> roots;
+      std::vector<std::complex<T>> chirp, filter;
+    };
+    
+    /*
+     * The const methods can be called concurrently on the same instance (the scratch buffers
+     * are per thread, see 'Workspace'), but not concurrently with the setters.
+     *
+     * Every fft method has an optional 'workspace' argument, see 'Workspace'.
+     *
+     * Sizes that are not powers of two are supported, but when the caller can zero-pad,
+     * the fft of the next power of two is often faster (float, AVX-512):
+     * - mixed-radix sizes close to the next power of two are slower (441: 2.8 us vs 1.9 us for 512,
+     *   960: 4.8 vs 4.0, 1920: 10.5 vs 7.8), those far from it are faster (1152: 6.5 vs 8.4, 4800: 27 vs 36),
+     * - Bluestein sizes compute 2 ffts of the power of two above 2N, so they are always several times
+     *   slower (1009: 18.6 us vs 3.8 us for 1024).
+     */
     template<typename T>
     struct Algo_<imj::Tag, T> {
       using RealInput  = typename RealSignal_ <imj::Tag, T>::type;
@@ -366,30 +1143,68 @@ namespace imajuscule {
         context = c;
       }
       
+      // By default, the fastest instruction set supported by the cpu is used.
+      // 'i' must be supported by the cpu.
+      void setInstructionSet(simd::InstructionSet i) {
+        kernels = simd::makeLevelKernels<T>(i);
+      }
+      
+      // 2^15 complex<float> = 256 KB
+      static constexpr unsigned int default_parallel_grain = 1 << 15;
+      static constexpr unsigned int default_six_step_min_size = 1 << 21;
+      
+      /*
+       * The scratch buffers of a call.
+       *
+       * By default, every thread has its own workspaces, and a call uses one that no other call of the thread
+       * is using (a thread waiting in 'WorkStealingPool::parallel_for' runs other tasks, which can be ffts).
+       * They are kept for the next calls of the thread, so their buffers are allocated only when a call
+       * needs bigger ones: the first calls on a thread can allocate.
+       *
+       * A call can use a workspace of the caller instead (e.g. to prepare it in a non-realtime thread
+       * by a first call of the same size). It must not be used by several calls at the same time.
+       */
+      struct Workspace {
+        RealFBins real;
+        std::vector<std::complex<T>> mixed_radix;
+        std::vector<std::complex<T>> bluestein;
+        std::vector<std::complex<T>> inplace;
+        std::vector<std::complex<T>> six_step;
+      };
+      
+      /*
+       * Enables the parallel mode (when 'p' is not null): ffts of at least 2*'grain' elements
+       * are split in tasks of at least 'grain' elements, run by the threads of 'p'.
+       *
+       * 'p' must outlive the ffts.
+       */
+      void setThreadPool(WorkStealingPool * p, unsigned int grain = default_parallel_grain) {
+        pool = p;
+        parallel_grain = grain;
+      }
+      
       void forward(typename RealInput::const_iterator inputBegin,
                    RealFBins & output,
-                   unsigned int N) const
+                   unsigned int N,
+                   Workspace * workspace = nullptr) const
       {
-        auto * const rootPtr = context.getRoots()->begin().base();
-        TukeyCooley<FftType::FORWARD, typename RealFBins::value_type::value_type>
-        algo{rootPtr};
-        
-        algo.run(inputBegin.base(),
-                 output.begin().base(),
-                 N);
+        ScopedWorkspace w(workspace);
+        run<FftType::FORWARD>(w,
+                              inputBegin.base(),
+                              output.begin().base(),
+                              N);
       }
       
       void inverse(RealFBins const & input,
                    RealInput & output,
-                   unsigned int N) const
+                   unsigned int N,
+                   Workspace * workspace = nullptr) const
       {
-        auto * const rootPtr = context.getRoots()->begin().base();
-        TukeyCooley<FftType::INVERSE, typename RealFBins::value_type::value_type>
-        algo{rootPtr};
-        
-        algo.run(input.begin().base(),
-                 output.begin().base(),
-                 N);
+        ScopedWorkspace w(workspace);
+        run<FftType::INVERSE>(w,
+                              input.begin().base(),
+                              output.begin().base(),
+                              N);
         
         // in theory for inverse fft we should convert_to_conjugate the result
         // but it is supposed to be real numbers so the conjugation would have no effect
@@ -409,7 +1224,306 @@ namespace imajuscule {
 #endif
       }
       
+      /*
+       * Forward fft of N real numbers.
+       *
+       * The N reals are seen as N/2 complex numbers (even samples in the real parts,
+       * odd samples in the imaginary parts) on which an N/2 complex fft is done,
+       * and the N/2+1 first bins of the spectrum are deduced in a post-pass
+       * (the other bins are the conjugates of these, by hermitian symmetry).
+       *
+       * 'output' has N/2+1 elements.
+       */
+      void forward_real(T const * input,
+                        RealFBins & output,
+                        unsigned int N,
+                        Workspace * workspace = nullptr) const
+      {
+        assert(N >= 2);
+        assert(N % 2 == 0);
+        assert(output.size() == N/2+1);
+        unsigned int const M = N/2;
+        ScopedWorkspace w(workspace);
+        // the roots of unity of N/2 are the even roots of unity of N
+        run<FftType::FORWARD>(w,
+                              reinterpret_cast<std::complex<T> const *>(input),
+                              output.begin().base(),
+                              M,
+                              2);
+        
+        auto * const z = output.begin().base();
+        {
+          auto const z0 = z[0];
+          z[0] = {z0.real() + z0.imag(), 0};
+          z[M] = {z0.real() - z0.imag(), 0};
+        }
+        for(unsigned int k=1; 2*k <= M; ++k) {
+          auto const a = z[k];
+          auto const b = z[M-k];
+          // even and odd parts of the spectrum, where O_k = (a - conj(b)) / 2i
+          auto const e = T(0.5) * (a + conj(b));
+          auto const o_times_i = T(0.5) * (a - conj(b));
+          std::complex<T> const o{o_times_i.imag(), -o_times_i.real()};
+          auto const w = context.getRoot(k);
+          z[k] = e + w * o;
+          if(k != M-k) {
+            // root[M-k] = -conj(root[k]), E_{M-k} = conj(e), O_{M-k} = conj(o)
+            z[M-k] = conj(e - w * o);
+          }
+        }
+      }
+      
+      /*
+       * Inverse of 'forward_real', with the same scale as 'inverse'
+       * (the result is multiplied by N).
+       *
+       * 'input' has N/2+1 elements, 'output' has N elements.
+       */
+      void inverse_real(RealFBins const & input,
+                        std::vector<T> & output,
+                        unsigned int N,
+                        Workspace * workspace = nullptr) const
+      {
+        assert(N >= 2);
+        assert(N % 2 == 0);
+        assert(input.size() == N/2+1);
+        assert(output.size() == N);
+        unsigned int const M = N/2;
+        // rebuild the spectrum of the N/2 complex numbers (multiplied by 2)
+        ScopedWorkspace w(workspace);
+        w->real.resize(M);
+        auto * const z = w->real.begin().base();
+        auto const * const x = input.begin().base();
+        z[0] = {x[0].real() + x[M].real(), x[0].real() - x[M].real()};
+        for(unsigned int k=1; k<M; ++k) {
+          auto const a = x[k];
+          auto const b = conj(x[M-k]);
+          auto const e = a + b;
+          auto const o = (a - b) * conj(context.getRoot(k));
+          z[k] = {e.real() - o.imag(), e.imag() + o.real()};
+        }
+        
+        auto * const result = reinterpret_cast<std::complex<T> *>(output.data());
+        run<FftType::INVERSE>(w, z, result, M, 2);
+        
+        // the inverse fft is the conjugate of the fft of the conjugate.
+        for(unsigned int n=0; n<M; ++n) {
+          result[n] = conj(result[n]);
+        }
+      }
+      
+      /*
+       * In-place versions of 'forward' and 'inverse': the N elements of 'data' are replaced by their fft,
+       * with the same scale as 'forward' and 'inverse' (and the same convention for the inverse:
+       * the result of 'inverse_inplace' is the conjugate of the inverse fft, which is the same
+       * when the inverse fft is real).
+       *
+       * For powers of two, no memory other than 'data' is used, so huge ffts need half the memory
+       * of the out-of-place api. Other sizes use an internal scratch buffer of N elements.
+       */
+      void forward_inplace(std::complex<T> * data,
+                           unsigned int N,
+                           Workspace * workspace = nullptr) const
+      {
+        run_inplace<FftType::FORWARD>(data, N, workspace);
+      }
+      
+      void inverse_inplace(std::complex<T> * data,
+                           unsigned int N,
+                           Workspace * workspace = nullptr) const
+      {
+        run_inplace<FftType::INVERSE>(data, N, workspace);
+      }
+      
+      /*
+       * Forward ffts of 'count' signals of N elements, sharing the context:
+       * signal i is read at 'input' + i*'input_distance',
+       * and its fft is written at 'output' + i*'output_distance'.
+       *
+       * The ffts are computed one after the other: computing the butterflies of several signals
+       * with the same vector instructions needs the signals interleaved, and interleaving and
+       * deinterleaving them cost more than the vectorization saves.
+       */
+      void forward_batch(std::complex<T> const * input,
+                         unsigned int input_distance,
+                         std::complex<T> * output,
+                         unsigned int output_distance,
+                         unsigned int count,
+                         unsigned int N,
+                         Workspace * workspace = nullptr) const
+      {
+        batch<FftType::FORWARD>(input, input_distance, output, output_distance, count, N, workspace);
+      }
+      
+      // Batch version of 'inverse', see 'forward_batch'.
+      void inverse_batch(std::complex<T> const * input,
+                         unsigned int input_distance,
+                         std::complex<T> * output,
+                         unsigned int output_distance,
+                         unsigned int count,
+                         unsigned int N,
+                         Workspace * workspace = nullptr) const
+      {
+        batch<FftType::INVERSE>(input, input_distance, output, output_distance, count, N, workspace);
+      }
+      
       Context context;
+      simd::LevelKernels<T> kernels = simd::bestLevelKernels<T>();
+      WorkStealingPool * pool = nullptr;
+      unsigned int parallel_grain = default_parallel_grain;
+      // From this size, power of two ffts use the six-step fft (except in-place ffts).
+      // Sizes smaller than SixStep::min_size never use it, whatever this value.
+      unsigned int six_step_min_size = default_six_step_min_size;
+    private:
+      // the workspaces of the current thread that are not used by a call.
+      static std::vector<std::unique_ptr<Workspace>> & free_workspaces() {
+        thread_local std::vector<std::unique_ptr<Workspace>> workspaces;
+        return workspaces;
+      }
+      
+      // The workspace of a call: 'external' when not null, else a workspace of the thread,
+      // acquired when it is first used (most power of two ffts don't use it).
+      struct ScopedWorkspace {
+        ScopedWorkspace(Workspace * external) : external(external) {}
+        ~ScopedWorkspace() {
+          if(w) {
+            free_workspaces().push_back(std::move(w));
+          }
+        }
+        
+        Workspace * operator ->() {
+          if(external) {
+            return external;
+          }
+          if(!w) {
+            auto & free = free_workspaces();
+            if(free.empty()) {
+              w = std::make_unique<Workspace>();
+            }
+            else {
+              w = std::move(free.back());
+              free.pop_back();
+            }
+          }
+          return w.get();
+        }
+        
+      private:
+        Workspace * const external;
+        std::unique_ptr<Workspace> w;
+        
+        ScopedWorkspace(const ScopedWorkspace&) = delete;
+        ScopedWorkspace& operator=(const ScopedWorkspace&) = delete;
+      };
+      
+      /*
+       * fft of size N, where the roots of unity of N are every 'fft_stride' root of the context:
+       * - powers of two use the radix-2 / radix-4 fft, or the six-step fft from 'six_step_min_size',
+       * - sizes whose prime factors are in 'mixed_radices' use the mixed-radix fft,
+       * - other sizes use Bluestein's algorithm.
+       */
+      template<FftType TYPE>
+      void run(ScopedWorkspace & w,
+               std::complex<T> const * input,
+               std::complex<T> * result,
+               unsigned int const N,
+               unsigned int const fft_stride = 1) const {
+        if(is_power_of_two(N) && N >= std::max(six_step_min_size, SixStep<TYPE, T>::min_size)) {
+          w->six_step.resize(N);
+          SixStep<TYPE, T>{
+            context.getRoots()->data(),
+            kernels,
+            fft_stride * context.getStride(),
+            pool,
+            context.getTwiddles() == Twiddles::Octant
+          }.run(input, result, w->six_step.data(), N);
+        }
+        else if(is_power_of_two(N)) {
+          makeTukeyCooley<TYPE>(fft_stride).run(input, result, N);
+        }
+        else if(auto b = context.getBluestein(N)) {
+          run_bluestein<TYPE>(w, *b, input, result);
+        }
+        else {
+          w->mixed_radix.resize(2*N);
+          MixedRadix<TYPE, T>{
+            context.getRoots()->data(),
+            kernels,
+            fft_stride * context.getStride()
+          }.run(input, result, w->mixed_radix.data(), N);
+        }
+      }
+      
+      template<FftType TYPE>
+      void run_inplace(std::complex<T> * data,
+                       unsigned int const N,
+                       Workspace * workspace) const {
+        if(is_power_of_two(N)) {
+          makeTukeyCooley<TYPE>().run_inplace(data, N);
+          return;
+        }
+        ScopedWorkspace w(workspace);
+        w->inplace.assign(data, data + N);
+        run<TYPE>(w, w->inplace.data(), data, N);
+      }
+      
+      template<FftType TYPE>
+      void run_bluestein(ScopedWorkspace & w,
+                         Bluestein<T> const & b,
+                         std::complex<T> const * input,
+                         std::complex<T> * result) const {
+        w->bluestein.resize(2*b.M);
+        auto * const x = w->bluestein.data();
+        auto * const X = x + b.M;
+        for(unsigned int n=0; n<b.N; ++n) {
+          auto const c = (TYPE == FftType::FORWARD) ? input[n] : conj(input[n]);
+          x[n] = c * b.chirp[n];
+        }
+        std::fill(x + b.N, x + b.M, std::complex<T>{0,0});
+        
+        TukeyCooley<FftType::FORWARD, T>{b.roots.data(), kernels, 1, pool, parallel_grain}.run(x, X, b.M);
+        for(unsigned int k=0; k<b.M; ++k) {
+          X[k] *= b.filter[k];
+        }
+        // gives the conjugate of the convolution (the filter is already divided by M)
+        TukeyCooley<FftType::INVERSE, T>{b.roots.data(), kernels, 1, pool, parallel_grain}.run(X, x, b.M);
+        
+        for(unsigned int k=0; k<b.N; ++k) {
+          result[k] = b.chirp[k] * conj(x[k]);
+        }
+      }
+      
+      // 'fft_stride' : distance between consecutive roots of unity of the fft size,
+      // in the roots of unity of the context size.
+      template<FftType TYPE>
+      TukeyCooley<TYPE, T> makeTukeyCooley(unsigned int const fft_stride = 1) const {
+        return {
+          context.getRoots()->data(),
+          kernels,
+          fft_stride * context.getStride(),
+          pool,
+          parallel_grain,
+          context.getTwiddles() == Twiddles::Octant
+        };
+      }
+      
+      template<FftType TYPE>
+      void batch(std::complex<T> const * input,
+                 unsigned int const input_distance,
+                 std::complex<T> * output,
+                 unsigned int const output_distance,
+                 unsigned int const count,
+                 unsigned int const N,
+                 Workspace * workspace) const
+      {
+        ScopedWorkspace w(workspace);
+        for(unsigned int i=0; i<count; ++i) {
+          run<TYPE>(w,
+                    input + i*input_distance,
+                    output + i*output_distance,
+                    N);
+        }
+      }
     };
     
     
@@ -450,6 +1564,9 @@ namespace imajuscule {
       template<typename T>
       using ScopedContext = ScopedContext_<Tag, T>;
       
+      template<typename T>
+      using Contexts = Contexts_<Tag, T>;
+      
       template<typename T>
       using Algo = Algo_<Tag, T>;
     } // NS fft
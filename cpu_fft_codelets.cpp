@@ -0,0 +1,193 @@
+
+/*
+ * Fully specialized ffts of the small power of two sizes (2 to 64 elements), the "codelets".
+ *
+ * A codelet of size N loads its input in a local array (in bit-reversed order), computes the radix-2
+ * decimation in time levels with a recursion and loops of compile-time bounds, which the compiler entirely unrolls
+ * (the functions are always inlined, so that the unrolling doesn't depend on the inlining heuristics),
+ * using twiddle factors computed at compile time, and writes the result in natural order.
+ *
+ * They are used as standalone ffts for these sizes, and as the leaves of the bigger ffts (see TukeyCooley).
+ */
+namespace imajuscule::fft::codelet {
+
+  constexpr unsigned int max_size = 64;
+
+  namespace detail {
+    using Extended = long double;
+
+    // Taylor series of the sine and cosine, for 'x' in [0, pi/4]
+    constexpr Extended sin_first_octant(Extended x) {
+      Extended term = x;
+      Extended sum = x;
+      for(int n=1; n<16; ++n) {
+        term *= -x*x / ((2*n) * (2*n+1));
+        sum += term;
+      }
+      return sum;
+    }
+    constexpr Extended cos_first_octant(Extended x) {
+      Extended term = 1;
+      Extended sum = 1;
+      for(int n=1; n<16; ++n) {
+        term *= -x*x / ((2*n-1) * (2*n));
+        sum += term;
+      }
+      return sum;
+    }
+
+    // The roots of unity exp(-2 i pi k / N) for k in [0, N/2), like 'make_root_of_unity'
+    template<typename T, unsigned int N>
+    struct Roots {
+      T re[N/2] {};
+      T im[N/2] {};
+
+      constexpr Roots() {
+        constexpr Extended pi = 3.141592653589793238462643383279502884L;
+        for(unsigned int k=0; k<N/2; ++k) {
+          // the angle is 2 pi 'eighths' / (8*N), in [0, pi[
+          unsigned int eighths = 8*k;
+          bool const negate_cos = eighths > 2*N;
+          if(negate_cos) {
+            eighths = 4*N - eighths;
+          }
+          bool const swap = eighths > N;
+          if(swap) {
+            eighths = 2*N - eighths;
+          }
+          Extended const angle = pi * static_cast<Extended>(eighths) / static_cast<Extended>(4*N);
+          Extended c = cos_first_octant(angle);
+          Extended s = sin_first_octant(angle);
+          if(swap) {
+            Extended const tmp = c;
+            c = s;
+            s = tmp;
+          }
+          re[k] = static_cast<T>(negate_cos ? -c : c);
+          im[k] = static_cast<T>(-s);
+        }
+      }
+    };
+
+    template<typename T, unsigned int N>
+    constexpr Roots<T, N> roots{};
+
+    constexpr unsigned int reverse_bits(unsigned int i, unsigned int n_bits) {
+      unsigned int r = 0;
+      for(unsigned int b=0; b<n_bits; ++b) {
+        r = (r << 1) | ((i >> b) & 1);
+      }
+      return r;
+    }
+
+    // The bit-reversed indices in [0, N)
+    template<unsigned int N>
+    struct BitReversed {
+      unsigned int index[N] {};
+
+      constexpr BitReversed() {
+        for(unsigned int i=0; i<N; ++i) {
+          index[i] = reverse_bits(i, power_of_two_exponent(N));
+        }
+      }
+    };
+
+    template<unsigned int N>
+    constexpr BitReversed<N> bit_reversed{};
+
+    // Decimation in time levels, on N elements in bit-reversed order
+    template<unsigned int N, typename T>
+    __attribute__((always_inline))
+    inline void levels(std::complex<T> * __restrict x) {
+      if constexpr (N >= 2) {
+        constexpr unsigned int half = N/2;
+        levels<half>(x);
+        levels<half>(x + half);
+
+        constexpr auto const & w = roots<T, N>;
+        for(unsigned int k=0; k<half; ++k) {
+          // not std::complex multiplication: its handling of infinities and nans is a branch and a library call.
+          // The twiddles 1 and -i need no multiplication.
+          auto const a = x[k+half];
+          std::complex<T> o;
+          if(k == 0) {
+            o = a;
+          }
+          else if(4*k == N) {
+            // the twiddle is -i
+            o = {a.imag(), -a.real()};
+          }
+          else {
+            o = {a.real() * w.re[k] - a.imag() * w.im[k],
+                 a.real() * w.im[k] + a.imag() * w.re[k]};
+          }
+          x[k+half] = x[k] - o;
+          x[k] += o;
+        }
+      }
+    }
+  }
+
+  /*
+   * fft of size N, conjugating the input when 'CONJUGATE' is true
+   * (for the inverse fft, see FftType::INVERSE).
+   */
+  template<unsigned int N, bool CONJUGATE, typename T>
+  struct Codelet {
+    static_assert(is_power_of_two(N) && N <= max_size);
+
+    // fft of the N elements of 'input' that are 'input_stride' apart. 'input' and 'result' can alias.
+    __attribute__((always_inline))
+    static void run(std::complex<T> const * input,
+                    unsigned int const input_stride,
+                    std::complex<T> * result) {
+      std::complex<T> x[N];
+      for(unsigned int i=0; i<N; ++i) {
+        x[i] = load(input[detail::bit_reversed<N>.index[i] * input_stride]);
+      }
+      compute(x, result);
+    }
+
+    // fft of the N elements of 'data' which are in bit-reversed order, in place.
+    __attribute__((always_inline))
+    static void run_bit_reversed(std::complex<T> * data) {
+      std::complex<T> x[N];
+      for(unsigned int i=0; i<N; ++i) {
+        x[i] = load(data[i]);
+      }
+      compute(x, data);
+    }
+
+  private:
+    static std::complex<T> load(std::complex<T> const & c) {
+      return CONJUGATE ? conj(c) : c;
+    }
+
+    __attribute__((always_inline))
+    static void compute(std::complex<T> * __restrict x, std::complex<T> * result) {
+      detail::levels<N>(x);
+      for(unsigned int i=0; i<N; ++i) {
+        result[i] = x[i];
+      }
+    }
+  };
+
+  // fft of size N in [1, max_size], a power of two, see 'Codelet::run'
+  template<bool CONJUGATE, typename T>
+  void run(std::complex<T> const * input,
+           unsigned int const input_stride,
+           std::complex<T> * result,
+           unsigned int const N) {
+    switch(N) {
+      case 1:  return Codelet<1,  CONJUGATE, T>::run(input, input_stride, result);
+      case 2:  return Codelet<2,  CONJUGATE, T>::run(input, input_stride, result);
+      case 4:  return Codelet<4,  CONJUGATE, T>::run(input, input_stride, result);
+      case 8:  return Codelet<8,  CONJUGATE, T>::run(input, input_stride, result);
+      case 16: return Codelet<16, CONJUGATE, T>::run(input, input_stride, result);
+      case 32: return Codelet<32, CONJUGATE, T>::run(input, input_stride, result);
+      case 64: return Codelet<64, CONJUGATE, T>::run(input, input_stride, result);
+      default:
+        assert(0);
+    }
+  }
+}
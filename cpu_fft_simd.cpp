@@ -0,0 +1,1105 @@
+
+// Butterfly kernels of the cpu fft, and kernels multiplying spectra, vectorized for several instruction sets.
+//
+// The kernels are compiled for each instruction set using function attributes,
+// and the best kernels supported by the cpu are selected at runtime (when an fft is planned),
+// so that a single binary can run on different cpus.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMJ_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define IMJ_SIMD_X86 0
+#endif
+
+namespace imajuscule {
+  namespace fft {
+    namespace simd {
+
+      enum class InstructionSet {
+        Scalar,
+        SSE2,
+        AVX2_FMA,
+        AVX512
+      };
+
+      inline const char * toString(InstructionSet i) {
+        switch(i) {
+          case InstructionSet::Scalar:   return "Scalar";
+          case InstructionSet::SSE2:     return "SSE2";
+          case InstructionSet::AVX2_FMA: return "AVX2+FMA";
+          case InstructionSet::AVX512:   return "AVX-512";
+        }
+        return "?";
+      }
+
+      inline InstructionSet detectInstructionSet() {
+#if IMJ_SIMD_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f")) {
+          return InstructionSet::AVX512;
+        }
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+          return InstructionSet::AVX2_FMA;
+        }
+        if(__builtin_cpu_supports("sse2")) {
+          return InstructionSet::SSE2;
+        }
+#endif
+        return InstructionSet::Scalar;
+      }
+
+      // The cpuid query is done once per process.
+      inline InstructionSet bestInstructionSet() {
+        static InstructionSet const best = detectInstructionSet();
+        return best;
+      }
+
+      /*
+       * A level kernel computes, on 'sz' elements, the butterflies spanning 2*'half' elements
+       * (radix2), or the butterflies spanning 2*'half' then 4*'half' elements (radix4).
+       *
+       * 'root' are the roots of unity of the fft, and 'stride' is the distance
+       * between consecutive twiddle factors of the level 'half'.
+       *
+       * Only the butterflies whose index in their group is in ['j_begin', 'j_end') are computed,
+       * so that a level can be split in several parts. Vectorized kernels need
+       * 'j_end' - 'j_begin' to be a multiple of their width.
+       */
+      template<typename T>
+      using LevelKernel = void (*)(std::complex<T> * __restrict result,
+                                   unsigned int const sz,
+                                   unsigned int const half,
+                                   std::complex<T> const * __restrict root,
+                                   unsigned int const stride,
+                                   unsigned int const j_begin,
+                                   unsigned int const j_end);
+
+      template<typename T>
+      void level_radix2_scalar(std::complex<T> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<T> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        for(std::complex<T> * __restrict const end = result + sz;
+            result != end;
+            result += 2*half)
+        {
+          std::complex<T> const * __restrict root_it = root + j_begin*stride;
+          for(unsigned int j=j_begin; j<j_end; ++j, root_it += stride)
+          {
+            auto const t = result[j+half] * *root_it;
+            result[j+half] = result[j] - t;
+            result[j] += t;
+          }
+        }
+      }
+
+      template<typename T>
+      void level_radix4_scalar(std::complex<T> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<T> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        auto const half_stride = stride/2;
+        for(std::complex<T> * __restrict const end = result + sz;
+            result != end;
+            result += 4*half)
+        {
+          std::complex<T> * __restrict r0 = result;
+          std::complex<T> * __restrict r1 = result + half;
+          std::complex<T> * __restrict r2 = result + 2*half;
+          std::complex<T> * __restrict r3 = result + 3*half;
+          std::complex<T> const * __restrict root1 = root + j_begin*stride;
+          std::complex<T> const * __restrict root2 = root + j_begin*half_stride;
+          for(unsigned int j=j_begin; j<j_end; ++j, root1 += stride, root2 += half_stride)
+          {
+            auto const w1 = *root1;
+            auto const w2 = *root2;
+            // root[(j+half)*half_stride] = -i * w2
+            std::complex<T> const w3{w2.imag(), -w2.real()};
+
+            auto const t1 = r1[j] * w1;
+            auto const t3 = r3[j] * w1;
+            auto const a0 = r0[j] + t1;
+            auto const a1 = r0[j] - t1;
+            auto const a2 = r2[j] + t3;
+            auto const a3 = r2[j] - t3;
+
+            auto const u2 = a2 * w2;
+            auto const u3 = a3 * w3;
+            r0[j] = a0 + u2;
+            r2[j] = a0 - u2;
+            r1[j] = a1 + u3;
+            r3[j] = a1 - u3;
+          }
+        }
+      }
+
+      /*
+       * An odd radix kernel computes a stage of radix P (3, 5 or 7) of the mixed-radix fft:
+       * with L the size of the dfts of the stage, s = N/L and m = L/P, the dft of size P
+       * of the elements s*m apart starting at s*q + r (q < m, r < s) is multiplied by the twiddles
+       * root[s*q*j*root_stride] (j < P), and element j is written at s*P*q + s*j + r
+       * (Stockham autosort, decimation in frequency: the last stage writes in natural order).
+       *
+       * 'root' are the roots of unity of N, 'root_stride' apart.
+       * When 'conjugate' is true, the input is conjugated.
+       */
+      template<typename T>
+      using OddStageKernel = void (*)(unsigned int const P,
+                                      std::complex<T> const * __restrict src,
+                                      std::complex<T> * __restrict dst,
+                                      unsigned int const N,
+                                      unsigned int const s,
+                                      std::complex<T> const * __restrict root,
+                                      unsigned int const root_stride,
+                                      bool const conjugate);
+
+      // dft of odd size P: inputs k and P-k are combined, so that the multiplications are by reals.
+      // X[j] = x[0] + sum_k (x[k] + x[P-k]) cos(2 pi jk/P) - i (x[k] - x[P-k]) sin(2 pi jk/P)
+      template<unsigned int P, typename T>
+      __attribute__((always_inline))
+      inline void odd_dft(T (&re)[P], T (&im)[P],
+                          std::complex<T> const (&rp)[P]) {
+        static_assert(P % 2, "");
+        constexpr unsigned int H = (P-1)/2;
+        T sr[H+1], si[H+1], dr[H+1], di[H+1];
+        T x0r = re[0], x0i = im[0];
+        for(unsigned int k=1; k<=H; ++k) {
+          sr[k] = re[k] + re[P-k]; si[k] = im[k] + im[P-k];
+          dr[k] = re[k] - re[P-k]; di[k] = im[k] - im[P-k];
+          x0r += sr[k]; x0i += si[k];
+        }
+        for(unsigned int j=1; j<=H; ++j) {
+          T ar = re[0], ai = im[0], br = 0, bi = 0;
+          for(unsigned int k=1; k<=H; ++k) {
+            // rp[t] = (cos(2 pi t/P), -sin(2 pi t/P))
+            auto const & r = rp[(j*k) % P];
+            ar += sr[k] * r.real(); ai += si[k] * r.real();
+            br -= dr[k] * r.imag(); bi -= di[k] * r.imag();
+          }
+          // X[j] = a - i * b, X[P-j] = a + i * b
+          re[j] = ar + bi; im[j] = ai - br;
+          re[P-j] = ar - bi; im[P-j] = ai + br;
+        }
+        re[0] = x0r; im[0] = x0i;
+      }
+
+      // One dft of size P, on elements 'in_stride' floats apart, written 'out_stride' floats apart,
+      // multiplied by the twiddles (wr[j], wi[j]).
+      template<unsigned int P, typename T>
+      __attribute__((always_inline))
+      inline void odd_butterfly(T const * __restrict src,
+                                std::size_t const in_stride,
+                                T * __restrict dst,
+                                std::size_t const out_stride,
+                                std::complex<T> const (&rp)[P],
+                                T const (&wr)[P],
+                                T const (&wi)[P],
+                                T const im_sign) {
+        T re[P], im[P];
+        for(unsigned int k=0; k<P; ++k) {
+          re[k] = src[in_stride*k];
+          im[k] = im_sign * src[in_stride*k + 1];
+        }
+        odd_dft<P>(re, im, rp);
+        dst[0] = re[0];
+        dst[1] = im[0];
+        for(unsigned int j=1; j<P; ++j) {
+          dst[out_stride*j] = re[j] * wr[j] - im[j] * wi[j];
+          dst[out_stride*j + 1] = re[j] * wi[j] + im[j] * wr[j];
+        }
+      }
+
+      /*
+       * The innermost loop is over r (contiguous elements, with the same twiddles) when there are
+       * enough of them to fill vectors, else over q (the first stages, where s is small).
+       *
+       * (the loops are 'ivdep' because the number of alias checks of the radix-7 stages
+       * exceeds the limit of the vectorizer, although 'src' and 'dst' are restrict)
+       */
+      template<unsigned int P, typename T>
+      __attribute__((always_inline))
+      inline void odd_stage(std::complex<T> const * __restrict src_c,
+                            std::complex<T> * __restrict dst_c,
+                            unsigned int const N,
+                            unsigned int const s,
+                            std::complex<T> const * __restrict root,
+                            unsigned int const root_stride,
+                            bool const conjugate) {
+        constexpr unsigned int min_contiguous = 8;
+        T const * __restrict src = reinterpret_cast<T const *>(src_c);
+        T * __restrict dst = reinterpret_cast<T *>(dst_c);
+        // (indices are computed with std::size_t for the loops to be vectorized)
+        std::size_t const m = N/(s*P);
+        std::size_t const in_stride = 2*s*m;
+        std::size_t const out_stride = 2*static_cast<std::size_t>(s);
+        // roots of unity of P
+        std::complex<T> rp[P];
+        for(unsigned int t=0; t<P; ++t) {
+          rp[t] = root[(N/P)*t*root_stride];
+        }
+        T const im_sign = conjugate ? -1 : 1;
+        if(s >= min_contiguous) {
+          for(std::size_t q=0; q<m; ++q) {
+            T wr[P], wi[P];
+            for(unsigned int j=0; j<P; ++j) {
+              auto const w = root[s*q*j*root_stride];
+              wr[j] = w.real();
+              wi[j] = w.imag();
+            }
+            T const * const in = src + 2*s*q;
+            T * const out = dst + 2*s*P*q;
+#pragma GCC ivdep
+            for(std::size_t r=0; r<out_stride; r += 2) {
+              odd_butterfly<P>(in + r, in_stride, out + r, out_stride, rp, wr, wi, im_sign);
+            }
+          }
+        }
+        else {
+          for(std::size_t r=0; r<s; ++r) {
+#pragma GCC ivdep
+            for(std::size_t q=0; q<m; ++q) {
+              T wr[P], wi[P];
+              for(unsigned int j=0; j<P; ++j) {
+                auto const w = root[s*q*j*root_stride];
+                wr[j] = w.real();
+                wi[j] = w.imag();
+              }
+              odd_butterfly<P>(src + 2*(s*q + r), in_stride, dst + 2*(s*P*q + r), out_stride, rp, wr, wi, im_sign);
+            }
+          }
+        }
+      }
+
+      template<typename T>
+      __attribute__((always_inline))
+      inline void odd_stage(unsigned int const P,
+                            std::complex<T> const * __restrict src,
+                            std::complex<T> * __restrict dst,
+                            unsigned int const N,
+                            unsigned int const s,
+                            std::complex<T> const * __restrict root,
+                            unsigned int const root_stride,
+                            bool const conjugate) {
+        switch(P) {
+          case 3: return odd_stage<3>(src, dst, N, s, root, root_stride, conjugate);
+          case 5: return odd_stage<5>(src, dst, N, s, root, root_stride, conjugate);
+          case 7: return odd_stage<7>(src, dst, N, s, root, root_stride, conjugate);
+        }
+      }
+
+      template<typename T>
+      void odd_stage_scalar(unsigned int const P,
+                            std::complex<T> const * __restrict src,
+                            std::complex<T> * __restrict dst,
+                            unsigned int const N,
+                            unsigned int const s,
+                            std::complex<T> const * __restrict root,
+                            unsigned int const root_stride,
+                            bool const conjugate) {
+        odd_stage(P, src, dst, N, s, root, root_stride, conjugate);
+      }
+
+      /*
+       * Spectrum kernels multiply spectra element-wise, in the frequency domain part of convolutions:
+       *
+       * - 'multiply' computes a[i] *= b[i],
+       * - 'multiply_add' computes accum[i] += a[0][i] * b[0][i] + ... + a[K-1][i] * b[K-1][i]:
+       *   the K products of an element are accumulated in registers, so that 'accum' is read and written
+       *   once for all the products (for example, once for all the partitions of a partitioned convolution).
+       *
+       * The vectorized kernels keep the interleaved layout of std::complex: the real and imaginary parts
+       * of one operand are duplicated in registers, and the products are accumulated with fma
+       * in 2 accumulators (a*re(b) and swapped(a)*im(b)), which are combined once per element.
+       */
+      template<typename T>
+      using MultiplyKernel = void (*)(std::complex<T> * __restrict a,
+                                      std::complex<T> const * __restrict b,
+                                      unsigned int const n);
+
+      template<typename T>
+      using MultiplyAddKernel = void (*)(std::complex<T> * __restrict accum,
+                                         std::complex<T> const * const * a,
+                                         std::complex<T> const * const * b,
+                                         unsigned int const K,
+                                         unsigned int const n);
+
+      template<typename T>
+      void multiply_scalar(std::complex<T> * __restrict a,
+                           std::complex<T> const * __restrict b,
+                           unsigned int const n) {
+        for(unsigned int i=0; i<n; ++i) {
+          a[i] *= b[i];
+        }
+      }
+
+      // 'multiply_add' on the elements of index in ['i_begin', 'n')
+      template<typename T>
+      void multiply_add_range(std::complex<T> * __restrict accum,
+                              std::complex<T> const * const * a,
+                              std::complex<T> const * const * b,
+                              unsigned int const K,
+                              unsigned int const i_begin,
+                              unsigned int const n) {
+        for(unsigned int i=i_begin; i<n; ++i) {
+          std::complex<T> sum{};
+          for(unsigned int k=0; k<K; ++k) {
+            sum += a[k][i] * b[k][i];
+          }
+          accum[i] += sum;
+        }
+      }
+
+      template<typename T>
+      void multiply_add_scalar(std::complex<T> * __restrict accum,
+                               std::complex<T> const * const * a,
+                               std::complex<T> const * const * b,
+                               unsigned int const K,
+                               unsigned int const n) {
+        multiply_add_range(accum, a, b, K, 0, n);
+      }
+
+
+#if IMJ_SIMD_X86
+
+      ////////////////////////////////////////////////////////////////////
+      // AVX2 + FMA : 4 complex<float> / 2 complex<double> per register
+      ////////////////////////////////////////////////////////////////////
+
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256 cmul_avx2(__m256 const a, __m256 const b) {
+        __m256 const b_re = _mm256_moveldup_ps(b);
+        __m256 const b_im = _mm256_movehdup_ps(b);
+        __m256 const a_swapped = _mm256_permute_ps(a, 0xB1);
+        return _mm256_fmaddsub_ps(a, b_re, _mm256_mul_ps(a_swapped, b_im));
+      }
+
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256 mul_minus_i_avx2(__m256 const a) {
+        __m256 const sign = _mm256_castsi256_ps(_mm256_set_epi32(0x80000000, 0, 0x80000000, 0,
+                                                                 0x80000000, 0, 0x80000000, 0));
+        return _mm256_xor_ps(_mm256_permute_ps(a, 0xB1), sign);
+      }
+
+      // 'idx' are the indices (in complex numbers) of the 4 twiddles
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256 load_twiddles_avx2(std::complex<float> const * root, unsigned int const stride, __m128i const idx) {
+        if(stride == 1) {
+          return _mm256_loadu_ps(reinterpret_cast<float const *>(root));
+        }
+        // a complex<float> has the size of a double.
+        return _mm256_castpd_ps(_mm256_i32gather_pd(reinterpret_cast<double const *>(root), idx, 8));
+      }
+
+      __attribute__((target("avx2,fma")))
+      void level_radix2_avx2(std::complex<float> * __restrict result,
+                             unsigned int const sz,
+                             unsigned int const half,
+                             std::complex<float> const * __restrict root,
+                             unsigned int const stride,
+                             unsigned int const j_begin,
+                             unsigned int const j_end) {
+        if((j_end - j_begin) % 4) {
+          level_radix2_scalar(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        __m128i const idx = _mm_mullo_epi32(_mm_set_epi32(3,2,1,0), _mm_set1_epi32(stride));
+        for(std::complex<float> * __restrict const end = result + sz;
+            result != end;
+            result += 2*half)
+        {
+          float * __restrict r0 = reinterpret_cast<float *>(result);
+          float * __restrict r1 = reinterpret_cast<float *>(result + half);
+          std::complex<float> const * __restrict root_it = root + j_begin*stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 8, root_it += 4*stride)
+          {
+            __m256 const t = cmul_avx2(_mm256_loadu_ps(r1+j), load_twiddles_avx2(root_it, stride, idx));
+            __m256 const a = _mm256_loadu_ps(r0+j);
+            _mm256_storeu_ps(r1+j, _mm256_sub_ps(a, t));
+            _mm256_storeu_ps(r0+j, _mm256_add_ps(a, t));
+          }
+        }
+      }
+
+      __attribute__((target("avx2,fma")))
+      void level_radix4_avx2(std::complex<float> * __restrict result,
+                             unsigned int const sz,
+                             unsigned int const half,
+                             std::complex<float> const * __restrict root,
+                             unsigned int const stride,
+                             unsigned int const j_begin,
+                             unsigned int const j_end) {
+        if((j_end - j_begin) % 4) {
+          level_radix4_scalar(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        auto const half_stride = stride/2;
+        __m128i const idx1 = _mm_mullo_epi32(_mm_set_epi32(3,2,1,0), _mm_set1_epi32(stride));
+        __m128i const idx2 = _mm_mullo_epi32(_mm_set_epi32(3,2,1,0), _mm_set1_epi32(half_stride));
+        for(std::complex<float> * __restrict const end = result + sz;
+            result != end;
+            result += 4*half)
+        {
+          float * __restrict r0 = reinterpret_cast<float *>(result);
+          float * __restrict r1 = reinterpret_cast<float *>(result + half);
+          float * __restrict r2 = reinterpret_cast<float *>(result + 2*half);
+          float * __restrict r3 = reinterpret_cast<float *>(result + 3*half);
+          std::complex<float> const * __restrict root1 = root + j_begin*stride;
+          std::complex<float> const * __restrict root2 = root + j_begin*half_stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 8, root1 += 4*stride, root2 += 4*half_stride)
+          {
+            __m256 const w1 = load_twiddles_avx2(root1, stride, idx1);
+            __m256 const w2 = load_twiddles_avx2(root2, half_stride, idx2);
+            __m256 const w3 = mul_minus_i_avx2(w2);
+
+            __m256 const t1 = cmul_avx2(_mm256_loadu_ps(r1+j), w1);
+            __m256 const t3 = cmul_avx2(_mm256_loadu_ps(r3+j), w1);
+            __m256 const x0 = _mm256_loadu_ps(r0+j);
+            __m256 const x2 = _mm256_loadu_ps(r2+j);
+            __m256 const a0 = _mm256_add_ps(x0, t1);
+            __m256 const a1 = _mm256_sub_ps(x0, t1);
+            __m256 const u2 = cmul_avx2(_mm256_add_ps(x2, t3), w2);
+            __m256 const u3 = cmul_avx2(_mm256_sub_ps(x2, t3), w3);
+            _mm256_storeu_ps(r0+j, _mm256_add_ps(a0, u2));
+            _mm256_storeu_ps(r2+j, _mm256_sub_ps(a0, u2));
+            _mm256_storeu_ps(r1+j, _mm256_add_ps(a1, u3));
+            _mm256_storeu_ps(r3+j, _mm256_sub_ps(a1, u3));
+          }
+        }
+      }
+
+      // AVX2 + FMA : 2 complex<double> per register
+
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256d cmul_avx2(__m256d const a, __m256d const b) {
+        __m256d const b_re = _mm256_movedup_pd(b);
+        __m256d const b_im = _mm256_permute_pd(b, 0xF);
+        __m256d const a_swapped = _mm256_permute_pd(a, 0x5);
+        return _mm256_fmaddsub_pd(a, b_re, _mm256_mul_pd(a_swapped, b_im));
+      }
+
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256d mul_minus_i_avx2(__m256d const a) {
+        __m256d const sign = _mm256_set_pd(-0., 0., -0., 0.);
+        return _mm256_xor_pd(_mm256_permute_pd(a, 0x5), sign);
+      }
+
+      __attribute__((target("avx2,fma"), always_inline))
+      inline __m256d load_twiddles_avx2(std::complex<double> const * root, unsigned int const stride) {
+        auto const r = reinterpret_cast<double const *>(root);
+        if(stride == 1) {
+          return _mm256_loadu_pd(r);
+        }
+        return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(r)), _mm_loadu_pd(r + 2*stride), 1);
+      }
+
+      __attribute__((target("avx2,fma")))
+      void level_radix2_avx2(std::complex<double> * __restrict result,
+                             unsigned int const sz,
+                             unsigned int const half,
+                             std::complex<double> const * __restrict root,
+                             unsigned int const stride,
+                             unsigned int const j_begin,
+                             unsigned int const j_end) {
+        if((j_end - j_begin) % 2) {
+          level_radix2_scalar(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        for(std::complex<double> * __restrict const end = result + sz;
+            result != end;
+            result += 2*half)
+        {
+          double * __restrict r0 = reinterpret_cast<double *>(result);
+          double * __restrict r1 = reinterpret_cast<double *>(result + half);
+          std::complex<double> const * __restrict root_it = root + j_begin*stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 4, root_it += 2*stride)
+          {
+            __m256d const t = cmul_avx2(_mm256_loadu_pd(r1+j), load_twiddles_avx2(root_it, stride));
+            __m256d const a = _mm256_loadu_pd(r0+j);
+            _mm256_storeu_pd(r1+j, _mm256_sub_pd(a, t));
+            _mm256_storeu_pd(r0+j, _mm256_add_pd(a, t));
+          }
+        }
+      }
+
+      __attribute__((target("avx2,fma")))
+      void level_radix4_avx2(std::complex<double> * __restrict result,
+                             unsigned int const sz,
+                             unsigned int const half,
+                             std::complex<double> const * __restrict root,
+                             unsigned int const stride,
+                             unsigned int const j_begin,
+                             unsigned int const j_end) {
+        if((j_end - j_begin) % 2) {
+          level_radix4_scalar(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        auto const half_stride = stride/2;
+        for(std::complex<double> * __restrict const end = result + sz;
+            result != end;
+            result += 4*half)
+        {
+          double * __restrict r0 = reinterpret_cast<double *>(result);
+          double * __restrict r1 = reinterpret_cast<double *>(result + half);
+          double * __restrict r2 = reinterpret_cast<double *>(result + 2*half);
+          double * __restrict r3 = reinterpret_cast<double *>(result + 3*half);
+          std::complex<double> const * __restrict root1 = root + j_begin*stride;
+          std::complex<double> const * __restrict root2 = root + j_begin*half_stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 4, root1 += 2*stride, root2 += 2*half_stride)
+          {
+            __m256d const w1 = load_twiddles_avx2(root1, stride);
+            __m256d const w2 = load_twiddles_avx2(root2, half_stride);
+            __m256d const w3 = mul_minus_i_avx2(w2);
+
+            __m256d const t1 = cmul_avx2(_mm256_loadu_pd(r1+j), w1);
+            __m256d const t3 = cmul_avx2(_mm256_loadu_pd(r3+j), w1);
+            __m256d const x0 = _mm256_loadu_pd(r0+j);
+            __m256d const x2 = _mm256_loadu_pd(r2+j);
+            __m256d const a0 = _mm256_add_pd(x0, t1);
+            __m256d const a1 = _mm256_sub_pd(x0, t1);
+            __m256d const u2 = cmul_avx2(_mm256_add_pd(x2, t3), w2);
+            __m256d const u3 = cmul_avx2(_mm256_sub_pd(x2, t3), w3);
+            _mm256_storeu_pd(r0+j, _mm256_add_pd(a0, u2));
+            _mm256_storeu_pd(r2+j, _mm256_sub_pd(a0, u2));
+            _mm256_storeu_pd(r1+j, _mm256_add_pd(a1, u3));
+            _mm256_storeu_pd(r3+j, _mm256_sub_pd(a1, u3));
+          }
+        }
+      }
+
+      ////////////////////////////////////////////////////////////////////
+      // AVX-512 : 8 complex<float> / 4 complex<double> per register
+      ////////////////////////////////////////////////////////////////////
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512 cmul_avx512(__m512 const a, __m512 const b) {
+        __m512 const b_re = _mm512_moveldup_ps(b);
+        __m512 const b_im = _mm512_movehdup_ps(b);
+        __m512 const a_swapped = _mm512_permute_ps(a, 0xB1);
+        return _mm512_fmaddsub_ps(a, b_re, _mm512_mul_ps(a_swapped, b_im));
+      }
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512 mul_minus_i_avx512(__m512 const a) {
+        // negates the imaginary parts
+        __m512i const sign = _mm512_set_epi32(0x80000000, 0, 0x80000000, 0, 0x80000000, 0, 0x80000000, 0,
+                                              0x80000000, 0, 0x80000000, 0, 0x80000000, 0, 0x80000000, 0);
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_permute_ps(a, 0xB1)), sign));
+      }
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512 load_twiddles_avx512(std::complex<float> const * root, unsigned int const stride, __m256i const idx) {
+        if(stride == 1) {
+          return _mm512_loadu_ps(reinterpret_cast<float const *>(root));
+        }
+        return _mm512_castpd_ps(_mm512_i32gather_pd(idx, reinterpret_cast<double const *>(root), 8));
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void level_radix2_avx512(std::complex<float> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<float> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        if((j_end - j_begin) % 8) {
+          level_radix2_avx2(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        __m256i const idx = _mm256_mullo_epi32(_mm256_set_epi32(7,6,5,4,3,2,1,0), _mm256_set1_epi32(stride));
+        for(std::complex<float> * __restrict const end = result + sz;
+            result != end;
+            result += 2*half)
+        {
+          float * __restrict r0 = reinterpret_cast<float *>(result);
+          float * __restrict r1 = reinterpret_cast<float *>(result + half);
+          std::complex<float> const * __restrict root_it = root + j_begin*stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 16, root_it += 8*stride)
+          {
+            __m512 const t = cmul_avx512(_mm512_loadu_ps(r1+j), load_twiddles_avx512(root_it, stride, idx));
+            __m512 const a = _mm512_loadu_ps(r0+j);
+            _mm512_storeu_ps(r1+j, _mm512_sub_ps(a, t));
+            _mm512_storeu_ps(r0+j, _mm512_add_ps(a, t));
+          }
+        }
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void level_radix4_avx512(std::complex<float> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<float> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        if((j_end - j_begin) % 8) {
+          level_radix4_avx2(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        auto const half_stride = stride/2;
+        __m256i const idx1 = _mm256_mullo_epi32(_mm256_set_epi32(7,6,5,4,3,2,1,0), _mm256_set1_epi32(stride));
+        __m256i const idx2 = _mm256_mullo_epi32(_mm256_set_epi32(7,6,5,4,3,2,1,0), _mm256_set1_epi32(half_stride));
+        for(std::complex<float> * __restrict const end = result + sz;
+            result != end;
+            result += 4*half)
+        {
+          float * __restrict r0 = reinterpret_cast<float *>(result);
+          float * __restrict r1 = reinterpret_cast<float *>(result + half);
+          float * __restrict r2 = reinterpret_cast<float *>(result + 2*half);
+          float * __restrict r3 = reinterpret_cast<float *>(result + 3*half);
+          std::complex<float> const * __restrict root1 = root + j_begin*stride;
+          std::complex<float> const * __restrict root2 = root + j_begin*half_stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 16, root1 += 8*stride, root2 += 8*half_stride)
+          {
+            __m512 const w1 = load_twiddles_avx512(root1, stride, idx1);
+            __m512 const w2 = load_twiddles_avx512(root2, half_stride, idx2);
+            __m512 const w3 = mul_minus_i_avx512(w2);
+
+            __m512 const t1 = cmul_avx512(_mm512_loadu_ps(r1+j), w1);
+            __m512 const t3 = cmul_avx512(_mm512_loadu_ps(r3+j), w1);
+            __m512 const x0 = _mm512_loadu_ps(r0+j);
+            __m512 const x2 = _mm512_loadu_ps(r2+j);
+            __m512 const a0 = _mm512_add_ps(x0, t1);
+            __m512 const a1 = _mm512_sub_ps(x0, t1);
+            __m512 const u2 = cmul_avx512(_mm512_add_ps(x2, t3), w2);
+            __m512 const u3 = cmul_avx512(_mm512_sub_ps(x2, t3), w3);
+            _mm512_storeu_ps(r0+j, _mm512_add_ps(a0, u2));
+            _mm512_storeu_ps(r2+j, _mm512_sub_ps(a0, u2));
+            _mm512_storeu_ps(r1+j, _mm512_add_ps(a1, u3));
+            _mm512_storeu_ps(r3+j, _mm512_sub_ps(a1, u3));
+          }
+        }
+      }
+
+      // AVX-512 : 4 complex<double> per register
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512d cmul_avx512(__m512d const a, __m512d const b) {
+        __m512d const b_re = _mm512_movedup_pd(b);
+        __m512d const b_im = _mm512_permute_pd(b, 0xFF);
+        __m512d const a_swapped = _mm512_permute_pd(a, 0x55);
+        return _mm512_fmaddsub_pd(a, b_re, _mm512_mul_pd(a_swapped, b_im));
+      }
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512d mul_minus_i_avx512(__m512d const a) {
+        // negates the imaginary parts
+        __m512i const sign = _mm512_set_epi64(0x8000000000000000, 0, 0x8000000000000000, 0,
+                                              0x8000000000000000, 0, 0x8000000000000000, 0);
+        return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_permute_pd(a, 0x55)), sign));
+      }
+
+      // 'idx' are the indices (in doubles) of the real and imaginary parts of the 4 twiddles
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512d load_twiddles_avx512(std::complex<double> const * root, unsigned int const stride, __m256i const idx) {
+        if(stride == 1) {
+          return _mm512_loadu_pd(reinterpret_cast<double const *>(root));
+        }
+        return _mm512_i32gather_pd(idx, reinterpret_cast<double const *>(root), 8);
+      }
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m256i twiddles_indices_avx512(unsigned int const stride) {
+        __m256i const complex_idx = _mm256_mullo_epi32(_mm256_set_epi32(3,3,2,2,1,1,0,0), _mm256_set1_epi32(2*stride));
+        return _mm256_add_epi32(complex_idx, _mm256_set_epi32(1,0,1,0,1,0,1,0));
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void level_radix2_avx512(std::complex<double> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<double> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        if((j_end - j_begin) % 4) {
+          level_radix2_avx2(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        __m256i const idx = twiddles_indices_avx512(stride);
+        for(std::complex<double> * __restrict const end = result + sz;
+            result != end;
+            result += 2*half)
+        {
+          double * __restrict r0 = reinterpret_cast<double *>(result);
+          double * __restrict r1 = reinterpret_cast<double *>(result + half);
+          std::complex<double> const * __restrict root_it = root + j_begin*stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 8, root_it += 4*stride)
+          {
+            __m512d const t = cmul_avx512(_mm512_loadu_pd(r1+j), load_twiddles_avx512(root_it, stride, idx));
+            __m512d const a = _mm512_loadu_pd(r0+j);
+            _mm512_storeu_pd(r1+j, _mm512_sub_pd(a, t));
+            _mm512_storeu_pd(r0+j, _mm512_add_pd(a, t));
+          }
+        }
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void level_radix4_avx512(std::complex<double> * __restrict result,
+                               unsigned int const sz,
+                               unsigned int const half,
+                               std::complex<double> const * __restrict root,
+                               unsigned int const stride,
+                               unsigned int const j_begin,
+                               unsigned int const j_end) {
+        if((j_end - j_begin) % 4) {
+          level_radix4_avx2(result, sz, half, root, stride, j_begin, j_end);
+          return;
+        }
+        auto const half_stride = stride/2;
+        __m256i const idx1 = twiddles_indices_avx512(stride);
+        __m256i const idx2 = twiddles_indices_avx512(half_stride);
+        for(std::complex<double> * __restrict const end = result + sz;
+            result != end;
+            result += 4*half)
+        {
+          double * __restrict r0 = reinterpret_cast<double *>(result);
+          double * __restrict r1 = reinterpret_cast<double *>(result + half);
+          double * __restrict r2 = reinterpret_cast<double *>(result + 2*half);
+          double * __restrict r3 = reinterpret_cast<double *>(result + 3*half);
+          std::complex<double> const * __restrict root1 = root + j_begin*stride;
+          std::complex<double> const * __restrict root2 = root + j_begin*half_stride;
+          for(unsigned int j=2*j_begin; j<2*j_end; j += 8, root1 += 4*stride, root2 += 4*half_stride)
+          {
+            __m512d const w1 = load_twiddles_avx512(root1, stride, idx1);
+            __m512d const w2 = load_twiddles_avx512(root2, half_stride, idx2);
+            __m512d const w3 = mul_minus_i_avx512(w2);
+
+            __m512d const t1 = cmul_avx512(_mm512_loadu_pd(r1+j), w1);
+            __m512d const t3 = cmul_avx512(_mm512_loadu_pd(r3+j), w1);
+            __m512d const x0 = _mm512_loadu_pd(r0+j);
+            __m512d const x2 = _mm512_loadu_pd(r2+j);
+            __m512d const a0 = _mm512_add_pd(x0, t1);
+            __m512d const a1 = _mm512_sub_pd(x0, t1);
+            __m512d const u2 = cmul_avx512(_mm512_add_pd(x2, t3), w2);
+            __m512d const u3 = cmul_avx512(_mm512_sub_pd(x2, t3), w3);
+            _mm512_storeu_pd(r0+j, _mm512_add_pd(a0, u2));
+            _mm512_storeu_pd(r2+j, _mm512_sub_pd(a0, u2));
+            _mm512_storeu_pd(r1+j, _mm512_add_pd(a1, u3));
+            _mm512_storeu_pd(r3+j, _mm512_sub_pd(a1, u3));
+          }
+        }
+      }
+
+      ////////////////////////////////////////////////////////////////////
+      // Odd radix kernels : the generic code is compiled for each instruction set
+      ////////////////////////////////////////////////////////////////////
+
+      template<typename T>
+      __attribute__((target("avx2,fma")))
+      void odd_stage_avx2(unsigned int const P,
+                          std::complex<T> const * __restrict src,
+                          std::complex<T> * __restrict dst,
+                          unsigned int const N,
+                          unsigned int const s,
+                          std::complex<T> const * __restrict root,
+                          unsigned int const root_stride,
+                          bool const conjugate) {
+        odd_stage(P, src, dst, N, s, root, root_stride, conjugate);
+      }
+
+      template<typename T>
+      __attribute__((target("avx512f,avx2,fma")))
+      void odd_stage_avx512(unsigned int const P,
+                            std::complex<T> const * __restrict src,
+                            std::complex<T> * __restrict dst,
+                            unsigned int const N,
+                            unsigned int const s,
+                            std::complex<T> const * __restrict root,
+                            unsigned int const root_stride,
+                            bool const conjugate) {
+        odd_stage(P, src, dst, N, s, root, root_stride, conjugate);
+      }
+
+      ////////////////////////////////////////////////////////////////////
+      // Spectrum kernels
+      ////////////////////////////////////////////////////////////////////
+
+      // AVX2 + FMA
+
+      __attribute__((target("avx2,fma")))
+      void multiply_avx2(std::complex<float> * __restrict a,
+                         std::complex<float> const * __restrict b,
+                         unsigned int const n) {
+        unsigned int i = 0;
+        for(; i + 4 <= n; i += 4) {
+          float * const pa = reinterpret_cast<float *>(a + i);
+          __m256 const vb = _mm256_loadu_ps(reinterpret_cast<float const *>(b + i));
+          _mm256_storeu_ps(pa, cmul_avx2(_mm256_loadu_ps(pa), vb));
+        }
+        multiply_scalar(a + i, b + i, n - i);
+      }
+
+      __attribute__((target("avx2,fma")))
+      void multiply_avx2(std::complex<double> * __restrict a,
+                         std::complex<double> const * __restrict b,
+                         unsigned int const n) {
+        unsigned int i = 0;
+        for(; i + 2 <= n; i += 2) {
+          double * const pa = reinterpret_cast<double *>(a + i);
+          __m256d const vb = _mm256_loadu_pd(reinterpret_cast<double const *>(b + i));
+          _mm256_storeu_pd(pa, cmul_avx2(_mm256_loadu_pd(pa), vb));
+        }
+        multiply_scalar(a + i, b + i, n - i);
+      }
+
+      __attribute__((target("avx2,fma")))
+      void multiply_add_avx2(std::complex<float> * __restrict accum,
+                             std::complex<float> const * const * a,
+                             std::complex<float> const * const * b,
+                             unsigned int const K,
+                             unsigned int const n) {
+        unsigned int i = 0;
+        // 2 registers of 4 complex numbers per iteration
+        for(; i + 8 <= n; i += 8) {
+          __m256 x0 = _mm256_setzero_ps(), y0 = _mm256_setzero_ps();
+          __m256 x1 = _mm256_setzero_ps(), y1 = _mm256_setzero_ps();
+          for(unsigned int k=0; k<K; ++k) {
+            float const * const ak = reinterpret_cast<float const *>(a[k] + i);
+            float const * const bk = reinterpret_cast<float const *>(b[k] + i);
+            __m256 const a0 = _mm256_loadu_ps(ak), a1 = _mm256_loadu_ps(ak + 8);
+            __m256 const b0 = _mm256_loadu_ps(bk), b1 = _mm256_loadu_ps(bk + 8);
+            x0 = _mm256_fmadd_ps(a0, _mm256_moveldup_ps(b0), x0);
+            y0 = _mm256_fmadd_ps(_mm256_permute_ps(a0, 0xB1), _mm256_movehdup_ps(b0), y0);
+            x1 = _mm256_fmadd_ps(a1, _mm256_moveldup_ps(b1), x1);
+            y1 = _mm256_fmadd_ps(_mm256_permute_ps(a1, 0xB1), _mm256_movehdup_ps(b1), y1);
+          }
+          float * const acc = reinterpret_cast<float *>(accum + i);
+          _mm256_storeu_ps(acc,     _mm256_add_ps(_mm256_loadu_ps(acc),     _mm256_addsub_ps(x0, y0)));
+          _mm256_storeu_ps(acc + 8, _mm256_add_ps(_mm256_loadu_ps(acc + 8), _mm256_addsub_ps(x1, y1)));
+        }
+        multiply_add_range(accum, a, b, K, i, n);
+      }
+
+      __attribute__((target("avx2,fma")))
+      void multiply_add_avx2(std::complex<double> * __restrict accum,
+                             std::complex<double> const * const * a,
+                             std::complex<double> const * const * b,
+                             unsigned int const K,
+                             unsigned int const n) {
+        unsigned int i = 0;
+        // 2 registers of 2 complex numbers per iteration
+        for(; i + 4 <= n; i += 4) {
+          __m256d x0 = _mm256_setzero_pd(), y0 = _mm256_setzero_pd();
+          __m256d x1 = _mm256_setzero_pd(), y1 = _mm256_setzero_pd();
+          for(unsigned int k=0; k<K; ++k) {
+            double const * const ak = reinterpret_cast<double const *>(a[k] + i);
+            double const * const bk = reinterpret_cast<double const *>(b[k] + i);
+            __m256d const a0 = _mm256_loadu_pd(ak), a1 = _mm256_loadu_pd(ak + 4);
+            __m256d const b0 = _mm256_loadu_pd(bk), b1 = _mm256_loadu_pd(bk + 4);
+            x0 = _mm256_fmadd_pd(a0, _mm256_movedup_pd(b0), x0);
+            y0 = _mm256_fmadd_pd(_mm256_permute_pd(a0, 0x5), _mm256_permute_pd(b0, 0xF), y0);
+            x1 = _mm256_fmadd_pd(a1, _mm256_movedup_pd(b1), x1);
+            y1 = _mm256_fmadd_pd(_mm256_permute_pd(a1, 0x5), _mm256_permute_pd(b1, 0xF), y1);
+          }
+          double * const acc = reinterpret_cast<double *>(accum + i);
+          _mm256_storeu_pd(acc,     _mm256_add_pd(_mm256_loadu_pd(acc),     _mm256_addsub_pd(x0, y0)));
+          _mm256_storeu_pd(acc + 4, _mm256_add_pd(_mm256_loadu_pd(acc + 4), _mm256_addsub_pd(x1, y1)));
+        }
+        multiply_add_range(accum, a, b, K, i, n);
+      }
+
+      // AVX-512
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void multiply_avx512(std::complex<float> * __restrict a,
+                           std::complex<float> const * __restrict b,
+                           unsigned int const n) {
+        unsigned int i = 0;
+        for(; i + 8 <= n; i += 8) {
+          float * const pa = reinterpret_cast<float *>(a + i);
+          __m512 const vb = _mm512_loadu_ps(reinterpret_cast<float const *>(b + i));
+          _mm512_storeu_ps(pa, cmul_avx512(_mm512_loadu_ps(pa), vb));
+        }
+        multiply_avx2(a + i, b + i, n - i);
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void multiply_avx512(std::complex<double> * __restrict a,
+                           std::complex<double> const * __restrict b,
+                           unsigned int const n) {
+        unsigned int i = 0;
+        for(; i + 4 <= n; i += 4) {
+          double * const pa = reinterpret_cast<double *>(a + i);
+          __m512d const vb = _mm512_loadu_pd(reinterpret_cast<double const *>(b + i));
+          _mm512_storeu_pd(pa, cmul_avx512(_mm512_loadu_pd(pa), vb));
+        }
+        multiply_avx2(a + i, b + i, n - i);
+      }
+
+      // x - y in the real parts, x + y in the imaginary parts
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512 addsub_avx512(__m512 const x, __m512 const y) {
+        return _mm512_mask_sub_ps(_mm512_add_ps(x, y), 0x5555, x, y);
+      }
+
+      __attribute__((target("avx512f,avx2,fma"), always_inline))
+      inline __m512d addsub_avx512(__m512d const x, __m512d const y) {
+        return _mm512_mask_sub_pd(_mm512_add_pd(x, y), 0x55, x, y);
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void multiply_add_avx512(std::complex<float> * __restrict accum,
+                               std::complex<float> const * const * a,
+                               std::complex<float> const * const * b,
+                               unsigned int const K,
+                               unsigned int const n) {
+        unsigned int i = 0;
+        // 2 registers of 8 complex numbers per iteration
+        for(; i + 16 <= n; i += 16) {
+          __m512 x0 = _mm512_setzero_ps(), y0 = _mm512_setzero_ps();
+          __m512 x1 = _mm512_setzero_ps(), y1 = _mm512_setzero_ps();
+          for(unsigned int k=0; k<K; ++k) {
+            float const * const ak = reinterpret_cast<float const *>(a[k] + i);
+            float const * const bk = reinterpret_cast<float const *>(b[k] + i);
+            __m512 const a0 = _mm512_loadu_ps(ak), a1 = _mm512_loadu_ps(ak + 16);
+            __m512 const b0 = _mm512_loadu_ps(bk), b1 = _mm512_loadu_ps(bk + 16);
+            x0 = _mm512_fmadd_ps(a0, _mm512_moveldup_ps(b0), x0);
+            y0 = _mm512_fmadd_ps(_mm512_permute_ps(a0, 0xB1), _mm512_movehdup_ps(b0), y0);
+            x1 = _mm512_fmadd_ps(a1, _mm512_moveldup_ps(b1), x1);
+            y1 = _mm512_fmadd_ps(_mm512_permute_ps(a1, 0xB1), _mm512_movehdup_ps(b1), y1);
+          }
+          float * const acc = reinterpret_cast<float *>(accum + i);
+          _mm512_storeu_ps(acc,      _mm512_add_ps(_mm512_loadu_ps(acc),      addsub_avx512(x0, y0)));
+          _mm512_storeu_ps(acc + 16, _mm512_add_ps(_mm512_loadu_ps(acc + 16), addsub_avx512(x1, y1)));
+        }
+        multiply_add_range(accum, a, b, K, i, n);
+      }
+
+      __attribute__((target("avx512f,avx2,fma")))
+      void multiply_add_avx512(std::complex<double> * __restrict accum,
+                               std::complex<double> const * const * a,
+                               std::complex<double> const * const * b,
+                               unsigned int const K,
+                               unsigned int const n) {
+        unsigned int i = 0;
+        // 2 registers of 4 complex numbers per iteration
+        for(; i + 8 <= n; i += 8) {
+          __m512d x0 = _mm512_setzero_pd(), y0 = _mm512_setzero_pd();
+          __m512d x1 = _mm512_setzero_pd(), y1 = _mm512_setzero_pd();
+          for(unsigned int k=0; k<K; ++k) {
+            double const * const ak = reinterpret_cast<double const *>(a[k] + i);
+            double const * const bk = reinterpret_cast<double const *>(b[k] + i);
+            __m512d const a0 = _mm512_loadu_pd(ak), a1 = _mm512_loadu_pd(ak + 8);
+            __m512d const b0 = _mm512_loadu_pd(bk), b1 = _mm512_loadu_pd(bk + 8);
+            x0 = _mm512_fmadd_pd(a0, _mm512_movedup_pd(b0), x0);
+            y0 = _mm512_fmadd_pd(_mm512_permute_pd(a0, 0x55), _mm512_permute_pd(b0, 0xFF), y0);
+            x1 = _mm512_fmadd_pd(a1, _mm512_movedup_pd(b1), x1);
+            y1 = _mm512_fmadd_pd(_mm512_permute_pd(a1, 0x55), _mm512_permute_pd(b1, 0xFF), y1);
+          }
+          double * const acc = reinterpret_cast<double *>(accum + i);
+          _mm512_storeu_pd(acc,     _mm512_add_pd(_mm512_loadu_pd(acc),     addsub_avx512(x0, y0)));
+          _mm512_storeu_pd(acc + 8, _mm512_add_pd(_mm512_loadu_pd(acc + 8), addsub_avx512(x1, y1)));
+        }
+        multiply_add_range(accum, a, b, K, i, n);
+      }
+
+#endif // IMJ_SIMD_X86
+
+      template<typename T>
+      struct LevelKernels {
+        InstructionSet instructionSet;
+        LevelKernel<T> radix2;
+        LevelKernel<T> radix4;
+        OddStageKernel<T> odd_stage;
+      };
+
+      template<typename T>
+      LevelKernels<T> makeLevelKernels(InstructionSet) {
+        // only float and double level kernels are vectorized.
+        return {InstructionSet::Scalar, level_radix2_scalar<T>, level_radix4_scalar<T>, odd_stage_scalar<T>};
+      }
+
+      template<typename T>
+      LevelKernels<T> makeVectorizedLevelKernels([[maybe_unused]] InstructionSet i) {
+#if IMJ_SIMD_X86
+        switch(i) {
+          case InstructionSet::AVX512:
+            return {i, level_radix2_avx512, level_radix4_avx512, odd_stage_avx512<T>};
+          case InstructionSet::AVX2_FMA:
+            return {i, level_radix2_avx2, level_radix4_avx2, odd_stage_avx2<T>};
+          case InstructionSet::SSE2:
+            // The scalar kernels, vectorized by the compiler for sse2, are faster than sse2 intrinsics
+            // (without fma, and with the shuffles of the complex products).
+            return {i, level_radix2_scalar<T>, level_radix4_scalar<T>, odd_stage_scalar<T>};
+          case InstructionSet::Scalar:
+            break;
+        }
+#endif
+        return {InstructionSet::Scalar, level_radix2_scalar<T>, level_radix4_scalar<T>, odd_stage_scalar<T>};
+      }
+
+      template<>
+      inline LevelKernels<float> makeLevelKernels<float>(InstructionSet i) {
+        return makeVectorizedLevelKernels<float>(i);
+      }
+
+      template<>
+      inline LevelKernels<double> makeLevelKernels<double>(InstructionSet i) {
+        return makeVectorizedLevelKernels<double>(i);
+      }
+
+      // Returns the fastest kernels supported by the cpu.
+      template<typename T>
+      LevelKernels<T> const & bestLevelKernels() {
+        static LevelKernels<T> const kernels = makeLevelKernels<T>(bestInstructionSet());
+        return kernels;
+      }
+
+      template<typename T>
+      struct SpectrumKernels {
+        InstructionSet instructionSet;
+        MultiplyKernel<T> multiply;
+        MultiplyAddKernel<T> multiply_add;
+      };
+
+      template<typename T>
+      SpectrumKernels<T> makeSpectrumKernels(InstructionSet) {
+        // only float and double spectrum kernels are vectorized.
+        return {InstructionSet::Scalar, multiply_scalar<T>, multiply_add_scalar<T>};
+      }
+
+      template<typename T>
+      SpectrumKernels<T> makeVectorizedSpectrumKernels([[maybe_unused]] InstructionSet i) {
+#if IMJ_SIMD_X86
+        switch(i) {
+          case InstructionSet::AVX512:
+            return {i, multiply_avx512, multiply_add_avx512};
+          case InstructionSet::AVX2_FMA:
+            return {i, multiply_avx2, multiply_add_avx2};
+          case InstructionSet::SSE2:
+            // without fma, the scalar kernels (vectorized by the compiler for sse2) are as fast.
+          case InstructionSet::Scalar:
+            break;
+        }
+#endif
+        return {InstructionSet::Scalar, multiply_scalar<T>, multiply_add_scalar<T>};
+      }
+
+      template<>
+      inline SpectrumKernels<float> makeSpectrumKernels<float>(InstructionSet i) {
+        return makeVectorizedSpectrumKernels<float>(i);
+      }
+
+      template<>
+      inline SpectrumKernels<double> makeSpectrumKernels<double>(InstructionSet i) {
+        return makeVectorizedSpectrumKernels<double>(i);
+      }
+
+      // Returns the fastest spectrum kernels supported by the cpu.
+      template<typename T>
+      SpectrumKernels<T> const & bestSpectrumKernels() {
+        static SpectrumKernels<T> const kernels = makeSpectrumKernels<T>(bestInstructionSet());
+        return kernels;
+      }
+
+    } // NS simd
+  } // NS fft
+} // NS imajuscule
@@ -0,0 +1,95 @@
+
+/*
+ * Measures the variants of the ffts of 'GpuFftPlan' to find the fastest one for a device.
+ */
+namespace imajuscule {
+
+  /*
+   * Returns the fastest 'FftTuning' of the ffts of 'size' on 'device', among every kernel file of 'GpuFftPlan::kernel_files'
+   * and every number of butterflies per work item (hence every workgroup size) supported by the device.
+   *
+   * The duration of a variant is the median of the durations of 'n_iterations' kernels, measured with profiling events.
+   *
+   * (The kernels are radix-2: there is no radix to choose.)
+   */
+  inline FftTuning tuneFft(cl_context context, cl_device_id device, unsigned int size, int n_iterations = 100) {
+    verify(n_iterations > 0);
+    verify(GpuFftPlan::fits(device, size));
+
+    cl_int ret;
+    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &ret);
+    CHECK_CL_ERROR(ret);
+
+    std::vector<float> input;
+    input.reserve(size);
+    for(unsigned int i=0; i<size; ++i) {
+      input.push_back(rand_float(0.f,1.f));
+    }
+
+    FftTuning best;
+    std::vector<double> durations(n_iterations);
+    for(auto kernel_file : GpuFftPlan::kernel_files) {
+      for(unsigned int nButterfliesPerThread = 1; nButterfliesPerThread <= size/2; nButterfliesPerThread *= 2) {
+        FftTuning t;
+        t.kernel_file = kernel_file;
+        t.nButterfliesPerThread = nButterfliesPerThread;
+        GpuFftPlan plan(context, device, queue, size, t);
+        if(plan.getTuning().nButterfliesPerThread != t.nButterfliesPerThread) {
+          // the workgroup would be too big
+          continue;
+        }
+        plan.write(input.data(), true);
+
+        constexpr int nSkipIterations = 5;
+        for(int i=0; i<nSkipIterations+n_iterations; ++i)
+        {
+          cl_event event;
+          plan.execute(0, NULL, &event);
+
+          ret = clWaitForEvents(1, &event);
+          CHECK_CL_ERROR(ret);
+
+          cl_ulong time_start, time_end;
+          ret = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+          CHECK_CL_ERROR(ret);
+          ret = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+          CHECK_CL_ERROR(ret);
+          ret = clReleaseEvent(event);
+          CHECK_CL_ERROR(ret);
+
+          if(i>=nSkipIterations) {
+            durations[i-nSkipIterations] = 1e-3 * (time_end - time_start);
+          }
+        }
+        // the median is less sensitive than the average to the preemptions of the device.
+        std::nth_element(durations.begin(), durations.begin() + n_iterations/2, durations.end());
+        t.microseconds = durations[n_iterations/2];
+
+        if(!best.nButterfliesPerThread || t.microseconds < best.microseconds) {
+          best = t;
+        }
+      }
+    }
+
+    ret = clReleaseCommandQueue(queue);
+    CHECK_CL_ERROR(ret);
+
+    verify(best.nButterfliesPerThread > 0);
+    return best;
+  }
+
+  /*
+   * Tunes the ffts of 'sizes' on 'device' (see 'tuneFft'), and saves the tunings in the tuning file (see 'FftTunings'),
+   * so that the next 'GpuFftPlan's use them.
+   */
+  inline void tuneFfts(cl_context context, cl_device_id device, std::vector<unsigned int> const & sizes, int n_iterations = 100) {
+    auto & tunings = FftTunings::getInstance();
+    for(auto size : sizes) {
+      tunings.set(device, size, tuneFft(context, device, size, n_iterations));
+    }
+    if(!tunings.getPath().empty()) {
+      tunings.save(tunings.getPath());
+    }
+  }
+
+} // NS imajuscule
@@ -0,0 +1,418 @@
+
+/*
+ * The measurements of the fft kernels, for the benchmark executable (see benchmark.cpp).
+ */
+namespace imajuscule {
+
+  // The arguments of the fft kernel files, which differ between the families of kernels.
+  enum class FftKernelArgs {
+    Twiddles,          // (input, twiddles, output)
+    LocalTwiddles,     // (local memory, input, twiddles, output)
+    Local,             // (local memory, input, output)
+    StockhamTwiddles,  // (input, twiddles, output, local pingpong memory)
+    Stockham           // (input, output, local pingpong memory)
+  };
+
+  /*
+   * A fft kernel file that computes the fft of 'size' real numbers in a single workgroup,
+   * with 'size/2' butterflies per level.
+   */
+  struct FftBenchmarkVariant {
+    // the kernel file without the "vector_fft_floats_" prefix and the ".cl" extension
+    std::string name;
+    std::string kernel_file;
+    FftKernelArgs args;
+    // true if the output is the fft of the bit-reversed input (cooley-tukey kernels),
+    // false if it is the fft of the input (stockham kernels).
+    bool bit_reversed;
+    // true if the output is the real parts then the imaginary parts, instead of complex numbers
+    bool separate_output;
+
+    bool hasTwiddles() const {
+      return args == FftKernelArgs::Twiddles || args == FftKernelArgs::LocalTwiddles || args == FftKernelArgs::StockhamTwiddles;
+    }
+
+    size_t localMemSize(unsigned int size) const {
+      switch(args) {
+        case FftKernelArgs::Twiddles:
+          return 0;
+        case FftKernelArgs::LocalTwiddles:
+        case FftKernelArgs::Local:
+          return size * sizeof(std::complex<float>);
+        default:
+          // the factor 2 is because we ping pong between two buffers.
+          return 2 * size * sizeof(std::complex<float>);
+      }
+    }
+  };
+
+  /*
+   * The registered variants.
+   *
+   * The kernels that need several kernel launches (the "huge" ones), images, or that
+   * are limited to 8 floats are not registered.
+   */
+  inline std::vector<FftBenchmarkVariant> const & fftBenchmarkVariants() {
+    static std::vector<FftBenchmarkVariant> const variants = []() {
+      std::vector<FftBenchmarkVariant> v;
+      auto add = [&v](std::string file, FftKernelArgs args, bool bit_reversed, bool separate_output) {
+        std::string name = file;
+        std::string const prefix = "vector_fft_floats_";
+        std::string const extension = ".cl";
+        verify(name.compare(0, prefix.size(), prefix) == 0);
+        verify(name.size() > prefix.size() + extension.size());
+        name = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+        v.push_back({std::move(name), std::move(file), args, bit_reversed, separate_output});
+      };
+      add("vector_fft_floats_multi.cl", FftKernelArgs::Twiddles, true, false);
+      add("vector_fft_floats_multi_local.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_coalesce.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_shifts.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_shifts_peel.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_shifts_twiddlesconstant.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_writeback.cl", FftKernelArgs::LocalTwiddles, true, false);
+      add("vector_fft_floats_multi_local_shifts_twiddles.cl", FftKernelArgs::Local, true, false);
+      add("vector_fft_floats_multi_local_shifts_twiddles_constantinput.cl", FftKernelArgs::Local, true, false);
+      add("vector_fft_floats_multi_local_coalesce_shifts_twiddles.cl", FftKernelArgs::Local, true, false);
+      add("vector_fft_floats_multi_local_coalesce_shifts_twiddles_separate.cl", FftKernelArgs::Local, true, true);
+      add("vector_fft_floats_multi_local_coalesce_shifts_twiddles_separatebis.cl", FftKernelArgs::Local, true, true);
+      add("vector_fft_floats_stockham_multi_local_coalesce.cl", FftKernelArgs::StockhamTwiddles, false, false);
+      add("vector_fft_floats_stockham_multi_local_coalesce_shift.cl", FftKernelArgs::StockhamTwiddles, false, false);
+      add("vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles.cl", FftKernelArgs::Stockham, false, false);
+      add("vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles_separate.cl", FftKernelArgs::Stockham, false, true);
+      return v;
+    }();
+    return variants;
+  }
+
+  inline FftBenchmarkVariant const * findFftBenchmarkVariant(std::string const & name) {
+    for(auto const & v : fftBenchmarkVariants()) {
+      if(v.name == name) {
+        return &v;
+      }
+    }
+    return nullptr;
+  }
+
+  // in microseconds
+  struct DurationStats {
+    double min = 0.;
+    double median = 0.;
+    double p99 = 0.;
+  };
+
+  inline DurationStats computeDurationStats(std::vector<double> durations) {
+    DurationStats s;
+    if(durations.empty()) {
+      return s;
+    }
+    std::sort(durations.begin(), durations.end());
+    auto const n = durations.size();
+    s.min = durations[0];
+    s.median = durations[n/2];
+    // the nearest rank
+    s.p99 = durations[std::min(n-1, static_cast<size_t>(std::ceil(0.99 * n)) - 1)];
+    return s;
+  }
+
+  struct FftBenchmarkOptions {
+    // The maximum number of measured iterations, per measurement.
+    int n_iterations = 1000;
+    // The measurement stops after this duration, even if there were less than 'n_iterations' iterations.
+    double max_seconds = 1.;
+    // 0 is the smallest number such that the workgroup size is supported by the kernel.
+    int nButterfliesPerThread = 0;
+    bool verify_results = false;
+  };
+
+  struct FftBenchmarkResult {
+    std::string variant;
+    unsigned int size = 0;
+    int nButterfliesPerThread = 0;
+    size_t workgroup_size = 0;
+    int n_kernel_iterations = 0;
+    int n_end_to_end_iterations = 0;
+    // measured with profiling events
+    DurationStats kernel;
+    // measured on the host: the copy of the input to the device, the kernel, and the copy of the output to the host.
+    DurationStats end_to_end;
+    // "ok", "error", or empty if the results were not verified
+    std::string verification;
+  };
+
+  /*
+   * Measures the fft of 'size' real numbers (a power of two, >= 2) computed by 'variant' on 'device',
+   * in 'queue' which must have been created with CL_QUEUE_PROFILING_ENABLE.
+   *
+   * Returns false if the device can't run the variant for this size (local memory, workgroup size),
+   * else true and sets 'result'.
+   */
+  inline bool benchmarkFft(cl_context context, cl_device_id device, cl_command_queue queue,
+                           FftBenchmarkVariant const & variant, unsigned int size,
+                           FftBenchmarkOptions const & options, FftBenchmarkResult & result) {
+    verify(is_power_of_two(size) && size >= 2);
+    verify(options.n_iterations > 0);
+
+    cl_ulong local_mem_sz;
+    cl_int ret = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_sz), &local_mem_sz, NULL);
+    CHECK_CL_ERROR(ret);
+    if(variant.localMemSize(size) > local_mem_sz) {
+      return false;
+    }
+
+    unsigned int const nButterflies = size/2;
+    KernelRegistry::Kernel kernel;
+    int nButterfliesPerThread = options.nButterfliesPerThread;
+    if(nButterfliesPerThread) {
+      if(nButterfliesPerThread < 0 ||
+         static_cast<unsigned int>(nButterfliesPerThread) > nButterflies ||
+         !is_power_of_two(nButterfliesPerThread)) {
+        return false;
+      }
+      kernel = KernelRegistry::getInstance().get(context, device,
+                                                 fftVariant(variant.kernel_file, nButterflies, nButterfliesPerThread),
+                                                 "kernel_func");
+      if(nButterflies > nButterfliesPerThread * kernel.getWorkGroupMaxSize()) {
+        return false;
+      }
+    }
+    else {
+      for(nButterfliesPerThread = 1;;) {
+        kernel = KernelRegistry::getInstance().get(context, device,
+                                                   fftVariant(variant.kernel_file, nButterflies, nButterfliesPerThread),
+                                                   "kernel_func");
+        size_t const workgroup_max_sz = kernel.getWorkGroupMaxSize();
+        if(nButterflies > nButterfliesPerThread * workgroup_max_sz) {
+          // We make the reasonnable assumption that "work group max size"
+          // won't be bigger if we increase 'nButterfliesPerThread':
+          nButterfliesPerThread = nButterflies / workgroup_max_sz;
+          continue;
+        }
+        break;
+      }
+    }
+    size_t const global_item_size = size/(2*nButterfliesPerThread);
+
+    std::vector<float> input;
+    input.reserve(size);
+    for(unsigned int i=0; i<size; ++i) {
+      input.push_back(rand_float(0.f,1.f));
+    }
+    // the output is 'size' complex numbers in both layouts
+    std::vector<float> output(2 * size);
+
+    cl_mem input_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, size * sizeof(float), NULL, &ret);
+    CHECK_CL_ERROR(ret);
+    cl_mem output_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY, output.size() * sizeof(float), NULL, &ret);
+    CHECK_CL_ERROR(ret);
+    cl_mem twiddle_mem = 0;
+    if(variant.hasTwiddles()) {
+      auto twiddle = compute_roots_of_unity<float>(size);
+      twiddle_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, twiddle.size() * sizeof(twiddle[0]), NULL, &ret);
+      CHECK_CL_ERROR(ret);
+      ret = clEnqueueWriteBuffer(queue, twiddle_mem, CL_TRUE, 0,
+                                 twiddle.size() * sizeof(twiddle[0]), twiddle.data(), 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+    }
+
+    std::vector<std::pair<size_t, void const *>> args;
+    auto const local = std::make_pair(variant.localMemSize(size), static_cast<void const *>(NULL));
+    auto const mem = [](cl_mem const & m) { return std::make_pair(sizeof(cl_mem), static_cast<void const *>(&m)); };
+    switch(variant.args) {
+      case FftKernelArgs::Twiddles:
+        args = {mem(input_mem), mem(twiddle_mem), mem(output_mem)};
+        break;
+      case FftKernelArgs::LocalTwiddles:
+        args = {local, mem(input_mem), mem(twiddle_mem), mem(output_mem)};
+        break;
+      case FftKernelArgs::Local:
+        args = {local, mem(input_mem), mem(output_mem)};
+        break;
+      case FftKernelArgs::StockhamTwiddles:
+        args = {mem(input_mem), mem(twiddle_mem), mem(output_mem), local};
+        break;
+      case FftKernelArgs::Stockham:
+        args = {mem(input_mem), mem(output_mem), local};
+        break;
+    }
+    for(cl_uint i=0; i<args.size(); ++i) {
+      ret = clSetKernelArg(kernel.get(), i, args[i].first, args[i].second);
+      CHECK_CL_ERROR(ret);
+    }
+
+    auto write = [&](cl_bool blocking) {
+      ret = clEnqueueWriteBuffer(queue, input_mem, blocking, 0, size * sizeof(float), input.data(), 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+    };
+    auto execute = [&](cl_event * event) {
+      ret = clEnqueueNDRangeKernel(queue, kernel.get(), 1, NULL,
+                                   &global_item_size,
+                                   &global_item_size,
+                                   0, NULL, event);
+      CHECK_CL_ERROR(ret);
+    };
+    auto read = [&]() {
+      ret = clEnqueueReadBuffer(queue, output_mem, CL_TRUE, 0, output.size() * sizeof(float), output.data(), 0, NULL, NULL);
+      CHECK_CL_ERROR(ret);
+    };
+
+    // Runs 'iteration' (which returns its duration) until there are 'n_iterations' durations, or 'max_seconds' have elapsed.
+    auto measure = [&options](auto iteration) {
+      constexpr int nSkipIterations = 5;
+      for(int i=0; i<nSkipIterations; ++i) {
+        iteration();
+      }
+      std::vector<double> durations;
+      durations.reserve(options.n_iterations);
+      auto const begin = std::chrono::steady_clock::now();
+      while(static_cast<int>(durations.size()) < options.n_iterations) {
+        durations.push_back(iteration());
+        if(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() >= options.max_seconds) {
+          break;
+        }
+      }
+      return durations;
+    };
+
+    write(CL_TRUE);
+    auto const kernel_durations = measure([&]() {
+      cl_event event;
+      execute(&event);
+      ret = clWaitForEvents(1, &event);
+      CHECK_CL_ERROR(ret);
+
+      cl_ulong time_start, time_end;
+      ret = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+      CHECK_CL_ERROR(ret);
+      ret = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+      CHECK_CL_ERROR(ret);
+      ret = clReleaseEvent(event);
+      CHECK_CL_ERROR(ret);
+      return 1e-3 * (time_end - time_start);
+    });
+
+    auto const end_to_end_durations = measure([&]() {
+      auto const begin = std::chrono::steady_clock::now();
+      write(CL_FALSE);
+      execute(NULL);
+      read();
+      return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+    });
+
+    result.variant = variant.name;
+    result.size = size;
+    result.nButterfliesPerThread = nButterfliesPerThread;
+    result.workgroup_size = global_item_size;
+    result.n_kernel_iterations = kernel_durations.size();
+    result.n_end_to_end_iterations = end_to_end_durations.size();
+    result.kernel = computeDurationStats(kernel_durations);
+    result.end_to_end = computeDurationStats(end_to_end_durations);
+    result.verification.clear();
+
+    if(options.verify_results) {
+      // 'output' is the output of the last end-to-end iteration
+      std::vector<std::complex<float>> actual;
+      if(variant.separate_output) {
+        actual = unseparate(output);
+      }
+      else {
+        actual.reserve(size);
+        for(unsigned int i=0; i<size; ++i) {
+          actual.emplace_back(output[2*i], output[2*i+1]);
+        }
+      }
+      std::vector<std::complex<float>> expected;
+      if(variant.bit_reversed) {
+        expected = cpu_fft_norecursion(input);
+      }
+      else {
+        expected = makeRefForwardFft(input);
+      }
+      bool ok = actual.size() == expected.size();
+      for(size_t i=0; ok && i<actual.size(); ++i) {
+        ok = close(actual[i], expected[i], 0.01f);
+      }
+      result.verification = ok ? "ok" : "error";
+    }
+
+    for(auto m : {input_mem, output_mem, twiddle_mem}) {
+      if(m) {
+        ret = clReleaseMemObject(m);
+        CHECK_CL_ERROR(ret);
+      }
+    }
+    return true;
+  }
+
+  /*
+   * The reports of the results, with a line (or an object) per (variant, size).
+   */
+
+  inline void writeFftBenchmarkCsv(std::ostream & os, std::string const & device, std::vector<FftBenchmarkResult> const & results) {
+    auto quoted = [](std::string const & s) {
+      std::string q = "\"";
+      for(auto c : s) {
+        if(c == '"') {
+          q += '"';
+        }
+        q += c;
+      }
+      return q + "\"";
+    };
+    os << "device,variant,size,butterflies_per_work_item,workgroup_size,"
+    << "kernel_iterations,kernel_min_us,kernel_median_us,kernel_p99_us,"
+    << "end_to_end_iterations,end_to_end_min_us,end_to_end_median_us,end_to_end_p99_us,"
+    << "verification" << std::endl;
+    for(auto const & r : results) {
+      os << quoted(device) << ',' << r.variant << ',' << r.size << ',' << r.nButterfliesPerThread << ',' << r.workgroup_size << ','
+      << r.n_kernel_iterations << ',' << r.kernel.min << ',' << r.kernel.median << ',' << r.kernel.p99 << ','
+      << r.n_end_to_end_iterations << ',' << r.end_to_end.min << ',' << r.end_to_end.median << ',' << r.end_to_end.p99 << ','
+      << r.verification << std::endl;
+    }
+  }
+
+  inline void writeFftBenchmarkJson(std::ostream & os, std::string const & device, std::vector<FftBenchmarkResult> const & results) {
+    auto quoted = [](std::string const & s) {
+      std::string q = "\"";
+      for(auto c : s) {
+        if(c == '"' || c == '\\') {
+          q += '\\';
+          q += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          q += buf;
+        }
+        else {
+          q += c;
+        }
+      }
+      return q + "\"";
+    };
+    auto stats = [&os](DurationStats const & s) {
+      os << "{\"min_us\": " << s.min << ", \"median_us\": " << s.median << ", \"p99_us\": " << s.p99 << "}";
+    };
+    os << "{" << std::endl
+    << "  \"device\": " << quoted(device) << "," << std::endl
+    << "  \"results\": [";
+    for(size_t i=0; i<results.size(); ++i) {
+      auto const & r = results[i];
+      os << (i ? "," : "") << std::endl
+      << "    {\"variant\": " << quoted(r.variant)
+      << ", \"size\": " << r.size
+      << ", \"butterflies_per_work_item\": " << r.nButterfliesPerThread
+      << ", \"workgroup_size\": " << r.workgroup_size
+      << ", \"kernel_iterations\": " << r.n_kernel_iterations
+      << ", \"kernel\": ";
+      stats(r.kernel);
+      os << ", \"end_to_end_iterations\": " << r.n_end_to_end_iterations
+      << ", \"end_to_end\": ";
+      stats(r.end_to_end);
+      os << ", \"verification\": " << (r.verification.empty() ? std::string("null") : quoted(r.verification))
+      << "}";
+    }
+    os << std::endl << "  ]" << std::endl << "}" << std::endl;
+  }
+
+} // NS imajuscule
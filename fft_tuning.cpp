@@ -0,0 +1,138 @@
+
+/*
+ * The parameters of the ffts of 'GpuFftPlan', per device and per size, measured by 'tuneFft'
+ * and persisted in a tuning file.
+ */
+namespace imajuscule {
+
+  struct FftTuning {
+    std::string kernel_file;
+    // The number of butterflies computed by each work item (the workgroup size is the number of butterflies divided by it).
+    // 0 is the smallest number such that the workgroup size is supported by the kernel.
+    int nButterfliesPerThread = 0;
+    // The measured duration of the kernel, 0 if unknown.
+    double microseconds = 0.;
+  };
+
+  /*
+   * The tunings of the ffts, which are loaded from the tuning file when 'getInstance' is first called.
+   *
+   * The file is the environment variable GPGPU_FFT_TUNING_FILE if it is set (an empty value disables the file),
+   * else fft_tuning.tsv in the directory of the 'ProgramCache'. It has a line per (device, size):
+   *
+   *   device <tab> size <tab> kernel file <tab> butterflies per thread <tab> kernel duration (us)
+   *
+   * The device is identified by its name, its vendor and the version of its driver, so that a tuning
+   * is not reused after a driver update.
+   */
+  struct FftTunings {
+    static FftTunings & getInstance() {
+      static FftTunings t;
+      return t;
+    }
+
+    std::string const & getPath() const { return path; }
+
+    // Returns true and sets 'tuning' if there is a tuning for the ffts of 'size' on 'device'.
+    bool find(cl_device_id device, unsigned int size, FftTuning & tuning) const {
+      std::lock_guard<std::mutex> l(mutex);
+      auto it = tunings.find(std::make_pair(deviceKey(device), size));
+      if(it == tunings.end()) {
+        return false;
+      }
+      tuning = it->second;
+      return true;
+    }
+
+    void set(cl_device_id device, unsigned int size, FftTuning const & tuning) {
+      std::lock_guard<std::mutex> l(mutex);
+      tunings[std::make_pair(deviceKey(device), size)] = tuning;
+    }
+
+    // Adds the tunings of the file 'p' (the lines that can't be parsed are ignored).
+    void load(std::string const & p) {
+      std::ifstream in(p);
+      std::string line;
+      std::lock_guard<std::mutex> l(mutex);
+      while(std::getline(in, line)) {
+        if(line.empty() || line[0] == '#') {
+          continue;
+        }
+        std::vector<std::string> fields;
+        for(size_t begin = 0;;) {
+          size_t const end = line.find('\t', begin);
+          fields.push_back(line.substr(begin, end - begin));
+          if(end == std::string::npos) {
+            break;
+          }
+          begin = end + 1;
+        }
+        if(fields.size() != 5) {
+          continue;
+        }
+        FftTuning t;
+        t.kernel_file = fields[2];
+        t.nButterfliesPerThread = atoi(fields[3].c_str());
+        t.microseconds = atof(fields[4].c_str());
+        unsigned int const size = strtoul(fields[1].c_str(), nullptr, 10);
+        if(!size || t.nButterfliesPerThread < 0) {
+          continue;
+        }
+        tunings[std::make_pair(fields[0], size)] = t;
+      }
+    }
+
+    // Writes all the tunings in the file 'p'.
+    void save(std::string const & p) const {
+      // written in a temporary file, then renamed, so that a concurrent process never reads a partial file.
+      std::string const tmp = p + "." + std::to_string(getpid()) + ".tmp";
+      {
+        std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+        out << "# device\tsize\tkernel file\tbutterflies per thread\tkernel duration (us)" << std::endl;
+        std::lock_guard<std::mutex> l(mutex);
+        for(auto const & t : tunings) {
+          out << t.first.first << '\t' << t.first.second << '\t'
+          << t.second.kernel_file << '\t' << t.second.nButterfliesPerThread << '\t' << t.second.microseconds << std::endl;
+        }
+        if(!out) {
+          out.close();
+          std::remove(tmp.c_str());
+          throw "tuning file not writable";
+        }
+      }
+      std::rename(tmp.c_str(), p.c_str());
+    }
+
+  private:
+    FftTunings() {
+      if(char const * p = getenv("GPGPU_FFT_TUNING_FILE")) {
+        path = p;
+      }
+      else if(!ProgramCache::getInstance().getDirectory().empty()) {
+        path = ProgramCache::getInstance().getDirectory() + "/fft_tuning.tsv";
+      }
+      if(!path.empty()) {
+        load(path);
+      }
+    }
+
+    std::string path;
+    mutable std::mutex mutex;
+    std::map<std::pair<std::string, unsigned int>, FftTuning> tunings;
+
+    static std::string deviceKey(cl_device_id device) {
+      std::string key;
+      for(auto param : {CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DRIVER_VERSION}) {
+        if(!key.empty()) {
+          key += " / ";
+        }
+        key += deviceString(device, param).c_str();
+      }
+      // the separators of the file
+      std::replace(key.begin(), key.end(), '\t', ' ');
+      std::replace(key.begin(), key.end(), '\n', ' ');
+      return key;
+    }
+  };
+
+} // NS imajuscule
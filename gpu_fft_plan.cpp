@@ -0,0 +1,172 @@
+
+/*
+ * An fft on an OpenCL device, whose program, kernel and buffers are created once.
+ */
+namespace imajuscule {
+
+  /*
+   * The fft of 'size' real numbers (a power of two, >= 2), whose output is 'size' complex numbers in natural order,
+   * computed by a stockham kernel of 'kernel_files' in the local memory of a single workgroup (see 'fits').
+   *
+   * The kernel file and the number of butterflies per work item are those of the 'FftTuning' of the size
+   * for the device (see 'FftTunings' and 'tuneFft'), if there is one.
+   *
+   * The constructor gets the kernel of the size from the 'KernelRegistry' (so that it is built once per size),
+   * allocates the input and output buffers of the device, and sets the kernel arguments.
+   * Then, 'write', 'execute' and 'read' only enqueue commands (in 'queue', which must outlive the plan),
+   * so repeated ffts only cost the transfers and the kernel, and creating a plan of a size that was used before is cheap.
+   */
+  struct GpuFftPlan {
+    // The kernels that have the same arguments (input, output, local memory), and the same output.
+    static constexpr std::array<char const *, 1> kernel_files{{
+      "vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles.cl"
+    }};
+
+    GpuFftPlan(cl_context context, cl_device_id device, cl_command_queue queue, unsigned int size)
+    : GpuFftPlan(context, device, queue, size, findTuning(device, size))
+    {}
+
+    // If 'tuning' is not supported by the device, the defaults are used (see 'getTuning').
+    GpuFftPlan(cl_context context, cl_device_id device, cl_command_queue queue, unsigned int size, FftTuning const & tuning)
+    : queue(queue)
+    , size(size)
+    {
+      verify(is_power_of_two(size) && size >= 2);
+      verify(fits(device, size));
+      buildKernel(context, device, tuning);
+
+      cl_int ret;
+      input_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, size * sizeof(float), NULL, &ret);
+      CHECK_CL_ERROR(ret);
+      output_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY, size * sizeof(std::complex<float>), NULL, &ret);
+      CHECK_CL_ERROR(ret);
+
+      ret = clSetKernelArg(kernel.get(), 0, sizeof(cl_mem), &input_mem);
+      CHECK_CL_ERROR(ret);
+      ret = clSetKernelArg(kernel.get(), 1, sizeof(cl_mem), &output_mem);
+      CHECK_CL_ERROR(ret);
+      // the factor 2 is because we ping pong between two buffers.
+      ret = clSetKernelArg(kernel.get(), 2, 2 * size * sizeof(std::complex<float>), NULL); // local memory
+      CHECK_CL_ERROR(ret);
+    }
+
+    ~GpuFftPlan() {
+      cl_int ret;
+      for(auto m : {input_mem, output_mem}) {
+        ret = clReleaseMemObject(m);
+        CHECK_CL_ERROR(ret);
+      }
+    }
+
+    // true when the local memory of 'device' can hold the 2 ping pong buffers of the fft of 'size'
+    static bool fits(cl_device_id device, unsigned int size) {
+      cl_ulong local_mem_sz;
+      cl_int ret = clGetDeviceInfo(device,
+                                   CL_DEVICE_LOCAL_MEM_SIZE,
+                                   sizeof(local_mem_sz), &local_mem_sz, NULL);
+      CHECK_CL_ERROR(ret);
+      return 2 * size * sizeof(std::complex<float>) <= local_mem_sz;
+    }
+
+    unsigned int getSize() const { return size; }
+    // The kernel file and the number of butterflies per work item that are used.
+    FftTuning const & getTuning() const { return tuning; }
+    int getButterfliesPerThread() const { return tuning.nButterfliesPerThread; }
+    size_t getGlobalSize() const { return global_item_size; }
+
+    // The buffers of the device, to chain other kernels with the fft.
+    cl_mem getInput() const { return input_mem; }
+    cl_mem getOutput() const { return output_mem; }
+
+    // Enqueues the copy of the 'getSize()' real numbers of 'input' to the device.
+    void write(float const * input, bool blocking = false, cl_event * event = NULL) {
+      cl_int ret = clEnqueueWriteBuffer(queue, input_mem, blocking ? CL_TRUE : CL_FALSE, 0,
+                                        size * sizeof(float), input, 0, NULL, event);
+      CHECK_CL_ERROR(ret);
+    }
+
+    // Enqueues the fft.
+    void execute(cl_uint n_events_to_wait = 0, cl_event const * events_to_wait = NULL, cl_event * event = NULL) {
+      cl_int ret = clEnqueueNDRangeKernel(queue, kernel.get(), 1, NULL,
+                                          &global_item_size,
+                                          &global_item_size,
+                                          n_events_to_wait, events_to_wait, event);
+      CHECK_CL_ERROR(ret);
+    }
+
+    // Enqueues the copy of the 'getSize()' complex numbers of the output to 'output'.
+    void read(std::complex<float> * output, bool blocking = true, cl_event * event = NULL) {
+      cl_int ret = clEnqueueReadBuffer(queue, output_mem, blocking ? CL_TRUE : CL_FALSE, 0,
+                                       size * sizeof(std::complex<float>), output, 0, NULL, event);
+      CHECK_CL_ERROR(ret);
+    }
+
+  private:
+    cl_command_queue queue;
+    unsigned int size;
+
+    KernelRegistry::Kernel kernel;
+    FftTuning tuning;
+    size_t global_item_size = 0;
+
+    cl_mem input_mem = 0;
+    cl_mem output_mem = 0;
+
+    static FftTuning findTuning(cl_device_id device, unsigned int size) {
+      FftTuning t;
+      if(!FftTunings::getInstance().find(device, size, t)) {
+        t.kernel_file = kernel_files[0];
+      }
+      return t;
+    }
+
+    void buildKernel(cl_context context, cl_device_id device, FftTuning const & requested) {
+      unsigned int const nButterflies = size/2;
+      tuning = requested;
+      if(std::find_if(kernel_files.begin(), kernel_files.end(),
+                      [&](char const * f) { return tuning.kernel_file == f; }) == kernel_files.end()) {
+        tuning.kernel_file = kernel_files[0];
+        tuning.nButterfliesPerThread = 0;
+      }
+      if(tuning.nButterfliesPerThread <= 0 ||
+         static_cast<unsigned int>(tuning.nButterfliesPerThread) > nButterflies ||
+         !is_power_of_two(tuning.nButterfliesPerThread)) {
+        tuning.nButterfliesPerThread = 0;
+      }
+      else {
+        kernel = KernelRegistry::getInstance().get(context, device,
+                                                   fftVariant(tuning.kernel_file, nButterflies, tuning.nButterfliesPerThread),
+                                                   "kernel_func");
+        if(nButterflies > tuning.nButterfliesPerThread * kernel.getWorkGroupMaxSize()) {
+          // the tuning is for a device that supported larger workgroups
+          tuning.nButterfliesPerThread = 0;
+        }
+      }
+
+      if(!tuning.nButterfliesPerThread) {
+        tuning.microseconds = 0.;
+        for(tuning.nButterfliesPerThread = 1;;) {
+          kernel = KernelRegistry::getInstance().get(context, device,
+                                                     fftVariant(tuning.kernel_file, nButterflies, tuning.nButterfliesPerThread),
+                                                     "kernel_func");
+          size_t const workgroup_max_sz = kernel.getWorkGroupMaxSize();
+          if(nButterflies > tuning.nButterfliesPerThread * workgroup_max_sz) {
+            // To estimate the next value of 'nButterfliesPerThread',
+            // we make the reasonnable assumption that "work group max size"
+            // won't be bigger if we increase 'nButterfliesPerThread':
+            tuning.nButterfliesPerThread = nButterflies / workgroup_max_sz;
+            continue;
+          }
+          break;
+        }
+      }
+      global_item_size = size/(2*tuning.nButterfliesPerThread);
+    }
+
+    GpuFftPlan(const GpuFftPlan&) = delete;
+    GpuFftPlan& operator=(const GpuFftPlan&) = delete;
+    GpuFftPlan(GpuFftPlan&&) = delete;
+    GpuFftPlan& operator=(GpuFftPlan&&) = delete;
+  };
+
+} // NS imajuscule
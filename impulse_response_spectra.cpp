@@ -0,0 +1,255 @@
+
+/*
+ * A file of the precomputed spectra of the partitions of impulse responses,
+ * for the 'NonUniformPartitionedConvolution' of each impulse response (e.g. the 4 of a true-stereo reverb).
+ *
+ * Layout (native endianness, the offsets are in bytes):
+ *
+ *   ImpulseResponseSpectraHeader
+ *   ImpulseResponseSpectraSegment[n_segments]          : the segments of 'NonUniformPartitionedConvolution::partition'
+ *   (the spectra, aligned on 'spectra_alignment' bytes): for every segment, for every impulse response,
+ *                                                        the partitions of the segment, each of ('block_size' + 1)
+ *                                                        std::complex<T> (the 'RealFBins_' layout)
+ *
+ * so that a mapped file is used without parsing and without copying.
+ */
+namespace imajuscule {
+
+  struct ImpulseResponseSpectraHeader {
+    static constexpr char expected_magic[8] = {'I','M','J','I','R','S','P','C'};
+    static constexpr uint32_t current_version = 1;
+
+    char magic[8];
+    uint32_t version;
+    // sizeof(T)
+    uint32_t sizeof_real;
+    uint32_t ir_size;
+    uint32_t block_size;
+    uint32_t max_block_size;
+    uint32_t n_impulse_responses;
+    uint32_t n_segments;
+    uint32_t reserved;
+  };
+
+  struct ImpulseResponseSpectraSegment {
+    uint32_t block_size;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t n_partitions;
+    // the spectra of the first impulse response
+    uint64_t spectra_offset;
+    // the distance between the spectra of 2 consecutive impulse responses
+    uint64_t spectra_stride;
+  };
+
+  constexpr uint64_t spectra_alignment = 64;
+
+  constexpr uint64_t align_spectra(uint64_t offset) {
+    return (offset + spectra_alignment - 1) & ~(spectra_alignment - 1);
+  }
+
+  // A read-only memory mapping of a file.
+  struct MappedFile {
+    MappedFile(std::string const & path) {
+      int const fd = open(path.c_str(), O_RDONLY);
+      if(fd < 0) {
+        throw "file not found";
+      }
+      struct stat st;
+      if(fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw "fstat error";
+      }
+      size = static_cast<size_t>(st.st_size);
+      if(size) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // the pages are read now rather than on the first accesses, which would be on the audio thread.
+        flags |= MAP_POPULATE;
+#endif
+        void * p = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if(p == MAP_FAILED) {
+          ::close(fd);
+          throw "mmap error";
+        }
+        data = static_cast<char const *>(p);
+#ifndef MAP_POPULATE
+        madvise(p, size, MADV_WILLNEED);
+#endif
+      }
+      ::close(fd);
+    }
+
+    ~MappedFile() {
+      if(data) {
+        munmap(const_cast<char *>(data), size);
+      }
+    }
+
+    char const * getData() const { return data; }
+    size_t getSize() const { return size; }
+
+  private:
+    char const * data = nullptr;
+    size_t size = 0;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+  };
+
+  /*
+   * Computes the spectra of the partitions of 'impulse_responses' (which can have different sizes:
+   * they are zero-padded to the size of the longest one) for a 'NonUniformPartitionedConvolution'
+   * of block size 'block_size', and writes them in the file 'path'.
+   */
+  template<typename T>
+  void saveImpulseResponseSpectra(std::string const & path,
+                                  std::vector<std::vector<T>> const & impulse_responses,
+                                  unsigned int const block_size,
+                                  unsigned int const max_block_size = NonUniformPartitionedConvolution<T>::default_max_block_size) {
+    verify(!impulse_responses.empty());
+    unsigned int ir_size = 0;
+    for(auto const & ir : impulse_responses) {
+      ir_size = std::max(ir_size, static_cast<unsigned int>(ir.size()));
+    }
+    auto const segments = NonUniformPartitionedConvolution<T>::partition(ir_size, block_size, max_block_size);
+    verify(!segments.empty());
+
+    ImpulseResponseSpectraHeader header{};
+    std::copy(std::begin(header.expected_magic), std::end(header.expected_magic), header.magic);
+    header.version = header.current_version;
+    header.sizeof_real = sizeof(T);
+    header.ir_size = ir_size;
+    header.block_size = block_size;
+    header.max_block_size = max_block_size;
+    header.n_impulse_responses = impulse_responses.size();
+    header.n_segments = segments.size();
+
+    std::vector<ImpulseResponseSpectraSegment> records;
+    uint64_t offset = align_spectra(sizeof(header) + segments.size() * sizeof(ImpulseResponseSpectraSegment));
+    for(auto const & s : segments) {
+      ImpulseResponseSpectraSegment r{};
+      r.block_size = s.block_size;
+      r.offset = s.offset;
+      r.size = s.size;
+      r.n_partitions = s.countPartitions();
+      r.spectra_offset = offset;
+      r.spectra_stride = align_spectra(r.n_partitions * (r.block_size + 1) * sizeof(std::complex<T>));
+      offset += impulse_responses.size() * r.spectra_stride;
+      records.push_back(r);
+    }
+
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out) {
+      throw "file not writable";
+    }
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(records.data()), records.size() * sizeof(ImpulseResponseSpectraSegment));
+
+    // the spectra are contiguous, after the alignment padding
+    std::vector<char> const padding(records[0].spectra_offset - out.tellp(), 0);
+    out.write(padding.data(), padding.size());
+
+    std::vector<std::complex<T>> spectra;
+    for(auto const & r : records) {
+      for(auto const & ir : impulse_responses) {
+        spectra.resize(r.spectra_stride / sizeof(std::complex<T>));
+        std::fill(spectra.begin(), spectra.end(), std::complex<T>{});
+        unsigned int const available = (ir.size() > r.offset) ? std::min<unsigned int>(r.size, ir.size() - r.offset) : 0;
+        UniformPartitionedConvolution<T>::computeSpectra(ir.data() + std::min<size_t>(r.offset, ir.size()),
+                                                         available,
+                                                         r.block_size,
+                                                         r.n_partitions,
+                                                         spectra.data());
+        out.write(reinterpret_cast<char const *>(spectra.data()), r.spectra_stride);
+      }
+    }
+    if(!out) {
+      throw "write error";
+    }
+  }
+
+  /*
+   * The spectra of a file written by 'saveImpulseResponseSpectra', mapped in memory.
+   *
+   * The spectra are used in place by the convolutions (see 'NonUniformPartitionedConvolution::setup'),
+   * so this object must outlive them.
+   */
+  template<typename T>
+  struct ImpulseResponseSpectra {
+    using SegmentSpectra = typename NonUniformPartitionedConvolution<T>::SegmentSpectra;
+
+    ImpulseResponseSpectra(std::string const & path)
+    : file(path)
+    {
+      if(file.getSize() < sizeof(ImpulseResponseSpectraHeader)) {
+        throw "not an impulse response spectra file";
+      }
+      header = reinterpret_cast<ImpulseResponseSpectraHeader const *>(file.getData());
+      if(!std::equal(std::begin(header->magic), std::end(header->magic), std::begin(header->expected_magic))) {
+        throw "not an impulse response spectra file";
+      }
+      if(header->version != header->current_version) {
+        throw "unsupported impulse response spectra file version";
+      }
+      if(header->sizeof_real != sizeof(T)) {
+        throw "the impulse response spectra file has another precision";
+      }
+      if(!header->n_segments ||
+         file.getSize() < sizeof(ImpulseResponseSpectraHeader) + header->n_segments * sizeof(ImpulseResponseSpectraSegment)) {
+        throw "truncated impulse response spectra file";
+      }
+      records = reinterpret_cast<ImpulseResponseSpectraSegment const *>(file.getData() + sizeof(ImpulseResponseSpectraHeader));
+      {
+        std::vector<typename NonUniformPartitionedConvolution<T>::Segment> segments;
+        for(unsigned int i=0; i<header->n_segments; ++i) {
+          segments.push_back({records[i].block_size, records[i].offset, records[i].size});
+        }
+        if(!NonUniformPartitionedConvolution<T>::isPartition(segments, header->ir_size, header->block_size, header->max_block_size)) {
+          throw "corrupted impulse response spectra file";
+        }
+      }
+      for(unsigned int i=0; i<header->n_segments; ++i) {
+        auto const & r = records[i];
+        if(r.n_partitions != UniformPartitionedConvolution<T>::countPartitions(r.size, r.block_size)) {
+          throw "corrupted impulse response spectra file";
+        }
+        if(r.spectra_offset % spectra_alignment ||
+           r.spectra_stride < uint64_t{r.n_partitions} * (r.block_size + 1) * sizeof(std::complex<T>) ||
+           r.spectra_offset > file.getSize() ||
+           r.spectra_stride > file.getSize() ||
+           r.spectra_offset + header->n_impulse_responses * r.spectra_stride > file.getSize()) {
+          throw "truncated impulse response spectra file";
+        }
+      }
+    }
+
+    unsigned int countImpulseResponses() const { return header->n_impulse_responses; }
+    unsigned int getImpulseResponseSize() const { return header->ir_size; }
+    unsigned int getBlockSize() const { return header->block_size; }
+    unsigned int getMaxBlockSize() const { return header->max_block_size; }
+
+    // The spectra of the impulse response 'i', for 'NonUniformPartitionedConvolution::setup'.
+    std::vector<SegmentSpectra> get(unsigned int i) const {
+      verify(i < countImpulseResponses());
+      std::vector<SegmentSpectra> res;
+      for(unsigned int k=0; k<header->n_segments; ++k) {
+        auto const & r = records[k];
+        res.push_back({
+          {r.block_size, r.offset, r.size},
+          r.n_partitions,
+          reinterpret_cast<std::complex<T> const *>(file.getData() + r.spectra_offset + i * r.spectra_stride)
+        });
+      }
+      return res;
+    }
+
+  private:
+    MappedFile file;
+    ImpulseResponseSpectraHeader const * header;
+    ImpulseResponseSpectraSegment const * records;
+  };
+
+} // NS imajuscule
@@ -0,0 +1,213 @@
+
+/*
+ * The variants of the kernels (a kernel file specialized by the values of its macros),
+ * built once and kept in memory, so that switching between variants (e.g. between fft sizes) is free.
+ */
+namespace imajuscule {
+
+  /*
+   * A kernel file, and the values of the macros it expects, which are passed as -D build options.
+   */
+  struct KernelVariant {
+    KernelVariant(std::string file, std::string options = std::string())
+    : file(std::move(file))
+    , options(std::move(options))
+    {}
+
+    KernelVariant & define(std::string const & name, std::string const & value) {
+      defines += " -D" + name + "=" + value;
+      return *this;
+    }
+    KernelVariant & define(std::string const & name, long long value) {
+      return define(name, std::to_string(value));
+    }
+
+    std::string const & getFile() const { return file; }
+
+    std::string buildOptions() const {
+      return "-I " + fullpath("") + " " + options + defines;
+    }
+
+  private:
+    std::string file;
+    std::string options;
+    std::string defines;
+  };
+
+  // -cl-fast-relaxed-math makes the twiddle fators computation a little faster
+  // but a little less accurate too.
+  constexpr auto fft_build_options = "-cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math";
+
+  /*
+   * The variant of the fft kernel file 'file' for ffts of 2*'nButterflies' elements,
+   * where each work item computes 'nButterfliesPerThread' butterflies, i.e the macros
+   * N_LOCAL_BUTTERFLIES, N_GLOBAL_BUTTERFLIES, LOG2_N_GLOBAL_BUTTERFLIES,
+   * MINUS_PI_over_N_GLOBAL_BUTTERFLIES and INPUT_SIZE.
+   */
+  inline KernelVariant fftVariant(std::string file, unsigned int nButterflies, unsigned int nButterfliesPerThread,
+                                  std::string options = fft_build_options) {
+    char buf[256];
+    memset(buf, 0, sizeof(buf));
+    // (the f suffix makes it a single precision constant)
+    snprintf(buf, sizeof(buf), "%af", (float)(-M_PI/nButterflies));
+
+    return KernelVariant(std::move(file), std::move(options))
+    .define("N_LOCAL_BUTTERFLIES", nButterfliesPerThread)
+    .define("N_GLOBAL_BUTTERFLIES", nButterflies)
+    .define("LOG2_N_GLOBAL_BUTTERFLIES", power_of_two_exponent(nButterflies))
+    .define("MINUS_PI_over_N_GLOBAL_BUTTERFLIES", buf)
+    .define("INPUT_SIZE", 2 * nButterflies);
+  }
+
+  /*
+   * The programs of the kernel variants, built once per (context, device, variant) (see 'buildProgram'),
+   * and their kernels.
+   *
+   * The kernel arguments are a state of a 'cl_kernel', hence a kernel is used by one owner at a time:
+   * 'get' returns a 'Kernel' that gives back its 'cl_kernel' to the registry when it is destroyed,
+   * for the next owner of the same kernel of the same variant.
+   *
+   * The OpenCL runtime may be unloaded before the static objects are destroyed, so the programs and the kernels
+   * are released by 'clear' (call it before releasing the context), not by the destructor.
+   */
+  struct KernelRegistry {
+    static KernelRegistry & getInstance() {
+      static KernelRegistry r;
+      return r;
+    }
+
+  private:
+    struct Pool {
+      size_t workgroup_max_size = 0;
+      std::vector<cl_kernel> available;
+      unsigned int in_use = 0;
+    };
+
+  public:
+    struct Kernel {
+      Kernel() = default;
+      ~Kernel() { reset(); }
+
+      Kernel(Kernel && o)
+      : pool(o.pool)
+      , kernel(o.kernel)
+      {
+        o.pool = nullptr;
+        o.kernel = 0;
+      }
+      Kernel& operator=(Kernel && o) {
+        if(this != &o) {
+          reset();
+          std::swap(pool, o.pool);
+          std::swap(kernel, o.kernel);
+        }
+        return *this;
+      }
+
+      cl_kernel get() const { return kernel; }
+
+      // CL_KERNEL_WORK_GROUP_SIZE, for the device of the variant
+      size_t getWorkGroupMaxSize() const { return pool->workgroup_max_size; }
+
+      // gives back the kernel to the registry
+      void reset() {
+        if(pool) {
+          KernelRegistry::getInstance().giveBack(*pool, kernel);
+          pool = nullptr;
+          kernel = 0;
+        }
+      }
+
+    private:
+      friend struct KernelRegistry;
+      Kernel(Pool & pool, cl_kernel kernel)
+      : pool(&pool)
+      , kernel(kernel)
+      {}
+
+      Pool * pool = nullptr;
+      cl_kernel kernel = 0;
+
+      Kernel(const Kernel&) = delete;
+      Kernel& operator=(const Kernel&) = delete;
+    };
+
+    // Returns the kernel 'name' of 'variant', for 'device' in 'context'.
+    Kernel get(cl_context context, cl_device_id device, KernelVariant const & variant, std::string const & name) {
+      std::lock_guard<std::mutex> l(mutex);
+
+      auto const options = variant.buildOptions();
+      auto & program = programs[std::make_tuple(context, device, variant.getFile(), options)];
+      if(!program.program) {
+        program.program = buildProgram(context, device, read_kernel(variant.getFile()), options);
+        ++built;
+      }
+
+      auto & pool = program.kernels[name];
+      cl_kernel kernel;
+      if(pool.available.empty()) {
+        cl_int ret;
+        kernel = clCreateKernel(program.program, name.c_str(), &ret);
+        CHECK_CL_ERROR(ret);
+        ret = clGetKernelWorkGroupInfo(kernel,
+                                       device,
+                                       CL_KERNEL_WORK_GROUP_SIZE,
+                                       sizeof(pool.workgroup_max_size), &pool.workgroup_max_size, NULL);
+        CHECK_CL_ERROR(ret);
+      }
+      else {
+        kernel = pool.available.back();
+        pool.available.pop_back();
+      }
+      ++pool.in_use;
+      return {pool, kernel};
+    }
+
+    // The number of programs built by the registry.
+    unsigned int countBuilt() const { return built; }
+
+    // Releases the programs and the kernels of 'context' (of all contexts if it is null),
+    // which must not be used anymore.
+    void clear(cl_context context = 0) {
+      std::lock_guard<std::mutex> l(mutex);
+      for(auto it = programs.begin(); it != programs.end();) {
+        if(context && std::get<0>(it->first) != context) {
+          ++it;
+          continue;
+        }
+        cl_int ret;
+        for(auto & k : it->second.kernels) {
+          verify(!k.second.in_use);
+          for(auto kernel : k.second.available) {
+            ret = clReleaseKernel(kernel);
+            CHECK_CL_ERROR(ret);
+          }
+        }
+        ret = clReleaseProgram(it->second.program);
+        CHECK_CL_ERROR(ret);
+        it = programs.erase(it);
+      }
+    }
+
+  private:
+    KernelRegistry() = default;
+
+    struct Program {
+      cl_program program = 0;
+      // (the nodes of a map are stable, 'Kernel' refers to the pools)
+      std::map<std::string, Pool> kernels;
+    };
+
+    std::mutex mutex;
+    std::map<std::tuple<cl_context, cl_device_id, std::string, std::string>, Program> programs;
+    unsigned int built = 0;
+
+    void giveBack(Pool & pool, cl_kernel kernel) {
+      std::lock_guard<std::mutex> l(mutex);
+      verify(pool.in_use);
+      --pool.in_use;
+      pool.available.push_back(kernel);
+    }
+  };
+
+} // NS imajuscule
@@ -1,31 +1,7 @@
 
-// common includes
+// common includes (shared with benchmark.cpp)
 
-#include <complex>
-#include <fstream>
-#include <iostream>
-#include <string>
-#include <stdio.h>
-#include <stdlib.h>
-#include <vector>
-#include <unordered_set>
-
-#ifdef __APPLE__
-#include <OpenCL/opencl.h>
-#else
-#include <CL/cl.h>
-#endif
-
-#include "error_check.cpp"
-
-#include "read_kernel_source.cpp"
-
-#include "math.cpp"
-#include "bitReverse.cpp"
-#include "rand.cpp"
-
-#include "cpu_fft.cpp"
-#include "cpu_fft_norecursion.cpp"
+#include "common_includes.cpp"
 
 
 
@@ -111,7 +87,8 @@
 
 // 10. This example computes an fft (Stockham radix-2)
 //    on vectors of large sizes,
-//    computing twiddle factors on the fly instead of reading them from memory:
+//    computing twiddle factors on the fly instead of reading them from memory,
+//    with a 'GpuFftPlan' per size (the program and the buffers are created once):
 //
 //#include "main_fft_many_floats_stockham_twiddles.cpp"
 
@@ -128,3 +105,26 @@
 //    using images instead of global memory for global input and output
 //
 //#include "main_fft_many_floats_stockham_twiddles_images.cpp"
+
+// 13. This example tunes the ffts of example 10 (the number of butterflies per work item, hence the workgroup size)
+//    for the device, and saves the tunings in a file that the next 'GpuFftPlan's use:
+//
+//#include "main_fft_autotune.cpp"
+
+
+
+//
+// CPU algorithms:
+//
+
+// This example verifies every path of the cpu fft against the dft, for every instruction set and twiddles storage,
+// and measures the cpu fft (instruction sets, small sizes, in-place, six-step, mixed-radix, Bluestein):
+//
+//#include "main_cpu_fft.cpp"
+
+
+// This example verifies the partitioned convolutions (uniform, non-uniform, and non-uniform with the tail on the gpu),
+// and measures their cpu cost for reverb impulse responses of 1, 5 and 10 seconds,
+// and their startup time with precomputed spectra:
+//
+//#include "main_convolution_benchmark.cpp"
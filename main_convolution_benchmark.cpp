@@ -0,0 +1,385 @@
+
+/*
+ This example measures the cpu cost of the uniformly partitioned convolution
+ (see 'UniformPartitionedConvolution') and of the non-uniformly partitioned convolution
+ (see 'NonUniformPartitionedConvolution'), for reverb impulse responses of several durations,
+ without and with the largest partitions convolved on the OpenCL device (see 'OpenCLUniformPartitionedConvolution'),
+ and compares the time per block of the device convolution with 3 kernels and with the fused kernel.
+
+ It also verifies that a stalled worker makes the non-uniform convolution drop blocks, without corrupting it,
+ and measures the startup time of a true-stereo reverb (4 impulse responses), when the spectra of the partitions
+ are computed, and when they are mapped from a file (see 'ImpulseResponseSpectra').
+
+ The cost is reported as the percentage of the realtime budget of one channel:
+ 100% means that one core processes one block in exactly the duration of the block.
+ */
+
+using T = float;
+using Convolution = imajuscule::UniformPartitionedConvolution<T>;
+using NonUniformConvolution = imajuscule::NonUniformPartitionedConvolution<T>;
+
+constexpr int sample_rate = 48000;
+
+// convolution of 'input' with 'ir', computed by the definition.
+std::vector<T> directConvolution(std::vector<T> const & input, std::vector<T> const & ir) {
+  std::vector<T> output(input.size(), T{});
+  for(int i=0; i<input.size(); ++i) {
+    for(int j=0; j<ir.size() && j<=i; ++j) {
+      output[i] += input[i-j] * ir[j];
+    }
+  }
+  return output;
+}
+
+std::vector<T> randomVector(unsigned int size) {
+  std::vector<T> v(size);
+  for(auto & e : v) {
+    e = rand_float(-1.f, 1.f);
+  }
+  return v;
+}
+
+// verifies that the convolution 'c', set up with 'ir', matches the direct convolution.
+template<typename Convolution>
+void verifyConvolution(Convolution & c, std::vector<T> const & ir) {
+  unsigned int const block_size = c.getBlockSize();
+  // a whole number of blocks
+  unsigned int const n_blocks = 8 * std::max(1u, static_cast<unsigned int>(ir.size()) / block_size);
+  auto const input = randomVector(n_blocks * block_size);
+  auto const ref = directConvolution(input, ir);
+
+  auto output = input;
+  for(int i=0; i<output.size(); i+=block_size) {
+    c.process(&output[i]);
+  }
+
+  T max_error{};
+  T max_ref{};
+  for(int i=0; i<ref.size(); ++i) {
+    max_error = std::max(max_error, std::abs(output[i] - ref[i]));
+    max_ref = std::max(max_ref, std::abs(ref[i]));
+  }
+  std::cout << "ir size " << ir.size() << ", block size " << block_size << ": relative error " << max_error / max_ref << std::endl;
+  verify(max_error <= 1e-4 * max_ref);
+}
+
+// an exponentially decaying noise, like a reverb
+std::vector<T> makeImpulseResponse(double seconds) {
+  std::vector<T> ir(static_cast<int>(seconds * sample_rate));
+  for(int i=0; i<ir.size(); ++i) {
+    ir[i] = rand_float(-1.f, 1.f) * std::exp(-6.9 * i / ir.size());
+  }
+  return ir;
+}
+
+// Returns the percentage of the realtime budget used to process one channel.
+double measureCpuPercent(double ir_seconds, unsigned int block_size) {
+  auto const ir = makeImpulseResponse(ir_seconds);
+  Convolution c;
+  c.setup(ir.data(), ir.size(), block_size);
+
+  auto block = randomVector(block_size);
+
+  // at least 1 second of audio, and the whole delay line
+  int const n_blocks = std::max(sample_rate / block_size, c.countPartitions());
+  // warm up the caches
+  for(int i=0; i<c.countPartitions(); ++i) {
+    c.process(block.data());
+  }
+  auto const start = std::chrono::steady_clock::now();
+  for(int i=0; i<n_blocks; ++i) {
+    c.process(block.data());
+  }
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+  double const audio_seconds = n_blocks * block_size / static_cast<double>(sample_rate);
+  return 100. * elapsed.count() / audio_seconds;
+}
+
+// Returns the average duration (in microseconds) of one block of the convolution on the OpenCL device.
+double measureOpenCLMicroseconds(cl_context context, cl_device_id device,
+                                 double ir_seconds, unsigned int block_size, bool fused) {
+  auto const ir = makeImpulseResponse(ir_seconds);
+  imajuscule::OpenCLUniformPartitionedConvolution c(context, device);
+  c.setFusedKernel(fused);
+  c.setup(ir.data(), ir.size(), block_size);
+
+  auto block = randomVector(block_size);
+
+  int const n_blocks = std::max(100u, sample_rate / block_size);
+  // warm up
+  for(int i=0; i<10; ++i) {
+    c.process(block.data());
+  }
+  auto const start = std::chrono::steady_clock::now();
+  for(int i=0; i<n_blocks; ++i) {
+    c.process(block.data());
+  }
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  return 1e6 * elapsed.count() / n_blocks;
+}
+
+/*
+ Runs the non-uniform convolution in realtime (the audio thread sleeps until the time of the next block)
+ during 'seconds', and prints the timings of every partition size.
+
+ When 'factory' is set, the tail sizes of at least 'offload_min_block_size' are convolved by 'factory' convolutions.
+ */
+void measureNonUniform(double ir_seconds,
+                       unsigned int block_size,
+                       double seconds,
+                       unsigned int max_block_size = NonUniformConvolution::default_max_block_size,
+                       NonUniformConvolution::TailFactory factory = {},
+                       unsigned int offload_min_block_size = 0) {
+  auto const ir = makeImpulseResponse(ir_seconds);
+  NonUniformConvolution c;
+  if(factory) {
+    c.setTailFactory(offload_min_block_size, factory);
+  }
+  c.setup(ir.data(), ir.size(), block_size, max_block_size);
+
+  auto block = randomVector(block_size);
+  std::chrono::duration<double> const block_duration(block_size / static_cast<double>(sample_rate));
+  auto next = std::chrono::steady_clock::now();
+  for(int i=0; i<seconds / block_duration.count(); ++i) {
+    c.process(block.data());
+    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(block_duration);
+    std::this_thread::sleep_until(next);
+  }
+
+  std::cout << std::endl << "ir " << ir_seconds << " s, block size " << block_size << ":" << std::endl;
+  // (the time of the offloaded sizes is mostly spent waiting for the device)
+  std::cout << "block size\tpartitions\toffset\t\tavg (us)\tmax (us)\ttime %\tmissed" << std::endl;
+  double total = 0.;
+  for(auto const & t : c.getTimings()) {
+    double const cpu = 100. * t.average_us / (1e6 * t.block_size / sample_rate);
+    total += cpu;
+    // 2 decimals
+    std::cout << t.block_size << (t.background ? "" : " (audio)") << (t.offloaded ? " (offloaded)" : "") << "\t" << t.count_partitions << "\t\t" << t.offset << "\t\t"
+    << std::round(100. * t.average_us) / 100. << "\t\t" << std::round(100. * t.max_us) / 100. << "\t\t"
+    << std::round(100. * cpu) / 100. << "\t" << t.missed_deadlines << std::endl;
+  }
+  std::cout << "total time %: " << std::round(100. * total) / 100. << std::endl;
+}
+
+/*
+ Verifies that a worker that is late by several blocks (the largest tail size is convolved by a convolution
+ that stalls) makes the non-uniform convolution drop blocks, without corrupting it:
+ once the input has been silent for the duration of the impulse response, the convolution is exact again.
+ */
+void stalledWorker() {
+  unsigned int const block_size = 64;
+  unsigned int const max_block_size = 512;
+  auto const ir = makeImpulseResponse(0.1);
+  NonUniformConvolution c;
+  c.setTailFactory(max_block_size, [](T const * ir, unsigned int ir_size, unsigned int block_size) {
+    auto conv = std::make_shared<Convolution>();
+    conv->setup(ir, ir_size, block_size);
+    auto count = std::make_shared<int>(0);
+    return [conv, count](T * block) {
+      if(++*count % 16 == 4) {
+        // late by 5 blocks of 512 samples
+        std::this_thread::sleep_for(std::chrono::milliseconds(55));
+      }
+      conv->process(block);
+    };
+  });
+  c.setup(ir.data(), ir.size(), block_size, max_block_size);
+
+  auto block = randomVector(block_size);
+  std::chrono::duration<double> const block_duration(block_size / static_cast<double>(sample_rate));
+  auto next = std::chrono::steady_clock::now();
+  for(unsigned int i=0; i<sample_rate / block_size; ++i) {
+    auto output = block;
+    c.process(output.data());
+    for(auto e : output) {
+      verify(std::isfinite(e));
+    }
+    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(block_duration);
+    std::this_thread::sleep_until(next);
+  }
+  auto const timings = c.getTimings();
+  std::cout << "stalled tail size " << timings.back().block_size << ": " << timings.back().missed_deadlines << " missed" << std::endl;
+  verify(timings.back().missed_deadlines > 0);
+
+  c.setWaitForWorkers(true);
+  std::vector<T> silence(block_size, T{});
+  for(unsigned int i=0; i<ir.size() + 4 * max_block_size; i+=block_size) {
+    c.process(silence.data());
+  }
+  verifyConvolution(c, ir);
+}
+
+/*
+ Verifies the convolution set up with the spectra of a file, and compares the startup time
+ of 4 convolutions of 'ir_seconds' (a true-stereo reverb) when the spectra are computed and when they are mapped.
+ */
+void spectraFileStartup(double ir_seconds, unsigned int block_size) {
+  std::string const path = "impulse_response_spectra.bin";
+
+  std::cout << "verifying results... " << std::endl;
+  for(unsigned int ir_size : {1, 100, 1000, 5000}) {
+    auto const ir = randomVector(ir_size);
+    imajuscule::saveImpulseResponseSpectra<T>(path, {ir}, 16, 256);
+    imajuscule::ImpulseResponseSpectra<T> spectra(path);
+    NonUniformConvolution c;
+    c.setWaitForWorkers(true);
+    c.setup(spectra.get(0));
+    verifyConvolution(c, ir);
+  }
+
+  std::vector<std::vector<T>> irs;
+  for(int i=0; i<4; ++i) {
+    irs.push_back(makeImpulseResponse(ir_seconds));
+  }
+  imajuscule::saveImpulseResponseSpectra(path, irs, block_size);
+
+  // (the spectra are mapped first, so that the fft contexts are created during this measure)
+  std::chrono::duration<double> mapped;
+  {
+    auto const start = std::chrono::steady_clock::now();
+    imajuscule::ImpulseResponseSpectra<T> spectra(path);
+    std::vector<std::unique_ptr<NonUniformConvolution>> convolutions;
+    for(unsigned int i=0; i<spectra.countImpulseResponses(); ++i) {
+      convolutions.push_back(std::make_unique<NonUniformConvolution>());
+      convolutions.back()->setup(spectra.get(i));
+    }
+    mapped = std::chrono::steady_clock::now() - start;
+    // (the convolutions are destroyed before the spectra)
+  }
+
+  std::chrono::duration<double> computed;
+  {
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<NonUniformConvolution>> convolutions;
+    for(auto const & ir : irs) {
+      convolutions.push_back(std::make_unique<NonUniformConvolution>());
+      convolutions.back()->setup(ir.data(), ir.size(), block_size);
+    }
+    computed = std::chrono::steady_clock::now() - start;
+  }
+  std::remove(path.c_str());
+
+  std::cout << "startup of 4 convolutions of " << ir_seconds << " s, block size " << block_size << ":" << std::endl;
+  // 2 decimals
+  std::cout << "spectra computed: " << std::round(100. * 1e3 * computed.count()) / 100. << " ms" << std::endl;
+  std::cout << "spectra mapped:   " << std::round(100. * 1e3 * mapped.count()) / 100. << " ms" << std::endl;
+}
+
+/*
+ Verifies the convolution where the largest tail sizes are convolved on the default OpenCL device
+ (which can be a cpu device, e.g. with PoCL), and measures it in realtime.
+ */
+void hybridConvolution() {
+  cl_platform_id platform_id = NULL;
+  cl_device_id device_id = NULL;
+  cl_uint ret_num_devices;
+  cl_uint ret_num_platforms;
+  cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
+  if(ret != CL_SUCCESS || !ret_num_platforms) {
+    std::cout << "no OpenCL platform." << std::endl;
+    return;
+  }
+  ret = clGetDeviceIDs( platform_id, CL_DEVICE_TYPE_DEFAULT, 1,
+                       &device_id, &ret_num_devices);
+  CHECK_CL_ERROR(ret);
+
+  cl_context context = clCreateContext( NULL, 1, &device_id, NULL, NULL, &ret);
+  CHECK_CL_ERROR(ret);
+
+  {
+    unsigned int const max_block_size = std::min(NonUniformConvolution::default_max_block_size,
+                                                 imajuscule::OpenCLUniformPartitionedConvolution::maxBlockSize(device_id));
+    auto const factory = imajuscule::makeOpenCLTailFactory(context, device_id);
+
+    std::cout << "verifying results... " << std::endl;
+    for(bool fused : {false, true}) {
+      for(unsigned int block_size : {16, 64}) {
+        for(unsigned int ir_size : {1, 100, 1000, 5000}) {
+          auto const ir = randomVector(ir_size);
+          NonUniformConvolution c;
+          c.setWaitForWorkers(true);
+          // all tail sizes are offloaded
+          c.setTailFactory(0, imajuscule::makeOpenCLTailFactory(context, device_id, fused));
+          c.setup(ir.data(), ir.size(), block_size, std::min(max_block_size, 16 * block_size));
+          verifyConvolution(c, ir);
+        }
+      }
+    }
+
+    // the fused kernel saves 2 launches and the round trips of the spectra through global memory,
+    // but the multiply-add of the partitions is done by a single workgroup.
+    std::cout << std::endl << "time per block on the device (us), 3 kernels / fused kernel:" << std::endl;
+    std::cout << "block size";
+    for(double ir_seconds : {1., 5.}) {
+      std::cout << "\tir " << ir_seconds << " s\t";
+    }
+    std::cout << std::endl;
+    for(unsigned int block_size = 64; block_size <= max_block_size; block_size *= 2) {
+      std::cout << block_size;
+      for(double ir_seconds : {1., 5.}) {
+        for(bool fused : {false, true}) {
+          // 2 decimals
+          std::cout << "\t" << std::round(100. * measureOpenCLMicroseconds(context, device_id, ir_seconds, block_size, fused)) / 100.;
+        }
+      }
+      std::cout << std::endl;
+    }
+
+    for(double ir_seconds : {1., 5., 10.}) {
+      // only the largest tail size is offloaded
+      measureNonUniform(ir_seconds, 64, 2., max_block_size, factory, max_block_size);
+    }
+  }
+
+  imajuscule::KernelRegistry::getInstance().clear(context);
+  ret = clReleaseContext(context);
+  CHECK_CL_ERROR(ret);
+}
+
+int main(void) {
+  srand(0); // we use rand() as random number generator and we want reproducible results so we use a fixed seeed.
+
+  std::cout << "verifying results... " << std::endl;
+  for(unsigned int block_size : {1, 2, 16, 64}) {
+    for(unsigned int ir_size : {1, 15, 64, 100, 1000}) {
+      auto const ir = randomVector(ir_size);
+      Convolution c;
+      c.setup(ir.data(), ir.size(), block_size);
+      verifyConvolution(c, ir);
+
+      NonUniformConvolution nc;
+      nc.setWaitForWorkers(true);
+      nc.setup(ir.data(), ir.size(), block_size, 16 * block_size);
+      verifyConvolution(nc, ir);
+    }
+  }
+  stalledWorker();
+
+  std::cout << std::endl << "cpu % per channel, at " << sample_rate << " Hz:" << std::endl;
+  std::cout << "block size";
+  for(double ir_seconds : {1., 5., 10.}) {
+    std::cout << "\tir " << ir_seconds << " s";
+  }
+  std::cout << std::endl;
+  for(unsigned int block_size = 64; block_size <= 8192; block_size *= 2) {
+    std::cout << block_size;
+    for(double ir_seconds : {1., 5., 10.}) {
+      // 2 decimals
+      std::cout << "\t\t" << std::round(100. * measureCpuPercent(ir_seconds, block_size)) / 100.;
+    }
+    std::cout << std::endl;
+  }
+
+  std::cout << std::endl << "non-uniform partitions, in realtime:" << std::endl;
+  for(double ir_seconds : {1., 5., 10.}) {
+    measureNonUniform(ir_seconds, 64, 2.);
+  }
+
+  std::cout << std::endl << "non-uniform partitions, with precomputed spectra:" << std::endl;
+  spectraFileStartup(10., 64);
+
+  std::cout << std::endl << "non-uniform partitions, with the tail on the OpenCL device, in realtime:" << std::endl;
+  hybridConvolution();
+  return 0;
+}
@@ -0,0 +1,462 @@
+
+/*
+ This example verifies the cpu fft ('Algo_<imj::Tag, T>') against the dft computed by the definition,
+ for float and double, for every instruction set supported by the cpu, with the full and the octant twiddles,
+ and without and with a thread pool:
+ - 'forward', 'inverse', 'forward_inplace', 'inverse_inplace',
+ - 'forward_batch', 'inverse_batch',
+ - 'forward_real', 'inverse_real',
+ on powers of two (with TukeyCooley and with the six-step fft), mixed-radix sizes and Bluestein sizes.
+
+ Then it measures the durations behind the comparisons of the history of cpu_fft.cpp:
+ the iterative fft versus the recursive fft it replaced, the instruction sets, the small sizes (codelets),
+ the in-place ffts, the octant twiddles, the six-step fft, and the sizes that are not powers of two.
+
+ The durations are the best of several runs, on one thread, except for the last table which measures
+ the scaling of the parallel mode with the number of threads and the grain.
+ */
+
+using namespace imajuscule;
+using namespace imajuscule::imj::fft;
+
+using simd::InstructionSet;
+
+// The instruction sets supported by the cpu.
+std::vector<InstructionSet> supportedInstructionSets() {
+  std::vector<InstructionSet> res;
+  for(auto i : {InstructionSet::Scalar, InstructionSet::SSE2, InstructionSet::AVX2_FMA, InstructionSet::AVX512}) {
+    if(i <= simd::bestInstructionSet()) {
+      res.push_back(i);
+    }
+  }
+  return res;
+}
+
+std::vector<std::complex<double>> randomSignal(unsigned int N) {
+  std::vector<std::complex<double>> v(N);
+  for(auto & e : v) {
+    e = {rand_float(-1.f, 1.f), rand_float(-1.f, 1.f)};
+  }
+  return v;
+}
+
+// the spectrum of a real signal, so that its inverse fft is real.
+std::vector<std::complex<double>> randomHermitianSignal(unsigned int N) {
+  auto v = randomSignal(N);
+  v[0].imag(0.);
+  if(N % 2 == 0) {
+    v[N/2].imag(0.);
+  }
+  for(unsigned int k=1; 2*k<N; ++k) {
+    v[N-k] = conj(v[k]);
+  }
+  return v;
+}
+
+// The dft by the definition. When 'conjugate' is true, the input is conjugated, like in the inverse ffts of Algo_.
+std::vector<std::complex<double>> dft(std::vector<std::complex<double>> const & x, bool conjugate = false) {
+  unsigned int const N = x.size();
+  std::vector<std::complex<double>> roots(N);
+  for(unsigned int n=0; n<N; ++n) {
+    roots[n] = std::polar(1.L, -2.L * M_PI * n / N);
+  }
+  std::vector<std::complex<double>> res(N);
+  for(unsigned int k=0; k<N; ++k) {
+    std::complex<double> sum;
+    // the index of the root of n*k, modulo N
+    for(unsigned int n=0, r=0; n<N; ++n, r = (r + k < N) ? r + k : r + k - N) {
+      sum += (conjugate ? conj(x[n]) : x[n]) * roots[r];
+    }
+    res[k] = sum;
+  }
+  return res;
+}
+
+template<typename T>
+std::vector<std::complex<T>> toComplex(std::vector<std::complex<double>> const & v) {
+  return {v.begin(), v.end()};
+}
+
+// The error of 'actual' relative to the magnitude of 'expected'.
+template<typename C>
+double relativeError(C const * actual, std::complex<double> const * expected, unsigned int n) {
+  double max_error = 0.;
+  double max_ref = 0.;
+  for(unsigned int i=0; i<n; ++i) {
+    max_error = std::max(max_error, std::abs(std::complex<double>(actual[i]) - expected[i]));
+    max_ref = std::max(max_ref, std::abs(expected[i]));
+  }
+  return max_ref ? max_error / max_ref : max_error;
+}
+
+// A signal, its spectrum, and a hermitian spectrum with its (real) inverse.
+struct Reference {
+  unsigned int N;
+  std::vector<std::complex<double>> signal, spectrum, hermitian, hermitian_inverse;
+  // 'batch_count' signals, and their spectra
+  std::vector<std::vector<std::complex<double>>> batch_signals, batch_spectra;
+};
+
+constexpr unsigned int batch_count = 3;
+
+Reference makeReference(unsigned int N) {
+  Reference r;
+  r.N = N;
+  r.signal = randomSignal(N);
+  r.spectrum = dft(r.signal);
+  r.hermitian = randomHermitianSignal(N);
+  r.hermitian_inverse = dft(r.hermitian, true);
+  for(unsigned int i=0; i<batch_count; ++i) {
+    r.batch_signals.push_back(randomSignal(N));
+    r.batch_spectra.push_back(dft(r.batch_signals.back()));
+  }
+  return r;
+}
+
+/*
+ Verifies all the paths of 'algo' on the size of 'ref', and returns the maximum relative error.
+ */
+template<typename T>
+double verifyAlgo(Algo<T> const & algo, Reference const & ref) {
+  using C = std::complex<T>;
+  unsigned int const N = ref.N;
+  double err = 0.;
+
+  auto const signal = toComplex<T>(ref.signal);
+  auto const hermitian = toComplex<T>(ref.hermitian);
+  std::vector<C> out(N);
+
+  algo.forward(signal.begin(), out, N);
+  err = std::max(err, relativeError(out.data(), ref.spectrum.data(), N));
+
+  algo.inverse(hermitian, out, N);
+  err = std::max(err, relativeError(out.data(), ref.hermitian_inverse.data(), N));
+
+  out = signal;
+  algo.forward_inplace(out.data(), N);
+  err = std::max(err, relativeError(out.data(), ref.spectrum.data(), N));
+
+  out = hermitian;
+  algo.inverse_inplace(out.data(), N);
+  err = std::max(err, relativeError(out.data(), ref.hermitian_inverse.data(), N));
+
+  {
+    // the signals are 1 element apart, and the spectra 2 elements apart
+    unsigned int const count = ref.batch_signals.size();
+    std::vector<C> in(count * (N+1)), spectra(count * (N+2));
+    for(unsigned int i=0; i<count; ++i) {
+      std::copy(ref.batch_signals[i].begin(), ref.batch_signals[i].end(), in.begin() + i*(N+1));
+    }
+    algo.forward_batch(in.data(), N+1, spectra.data(), N+2, count, N);
+    for(unsigned int i=0; i<count; ++i) {
+      err = std::max(err, relativeError(spectra.data() + i*(N+2), ref.batch_spectra[i].data(), N));
+    }
+    // the inverse of the spectra are the conjugates of the signals, multiplied by N.
+    algo.inverse_batch(spectra.data(), N+2, in.data(), N+1, count, N);
+    for(unsigned int i=0; i<count; ++i) {
+      std::vector<std::complex<double>> expected(N);
+      for(unsigned int k=0; k<N; ++k) {
+        expected[k] = conj(ref.batch_signals[i][k]) * static_cast<double>(N);
+      }
+      err = std::max(err, relativeError(in.data() + i*(N+1), expected.data(), N));
+    }
+  }
+
+  if(N % 2 == 0) {
+    // the real parts of the signal
+    std::vector<T> reals(N);
+    std::vector<std::complex<double>> x(N);
+    for(unsigned int i=0; i<N; ++i) {
+      reals[i] = ref.signal[i].real();
+      x[i] = reals[i];
+    }
+    auto const X = dft(x);
+    std::vector<C> half(N/2+1);
+    algo.forward_real(reals.data(), half, N);
+    err = std::max(err, relativeError(half.data(), X.data(), N/2+1));
+
+    std::vector<T> back(N);
+    algo.inverse_real(toComplex<T>({X.begin(), X.begin() + N/2+1}), back, N);
+    for(auto & e : x) {
+      e *= N;
+    }
+    err = std::max(err, relativeError(back.data(), x.data(), N));
+  }
+  return err;
+}
+
+template<typename T>
+void verifyAll(std::vector<Reference> const & refs, WorkStealingPool & pool) {
+  for(auto instructionSet : supportedInstructionSets()) {
+    for(auto twiddles : {Twiddles::Full, Twiddles::Octant}) {
+      for(bool parallel : {false, true}) {
+        double err = 0.;
+        double max_allowed = 0.;
+        for(auto const & ref : refs) {
+          // (the octant twiddles are only for powers of two)
+          ScopedContext<T> context(ref.N, twiddles);
+          Algo<T> algo(context.get());
+          algo.setInstructionSet(instructionSet);
+          if(parallel) {
+            // a small grain, so that the small ffts are split too
+            algo.setThreadPool(&pool, 64);
+          }
+          // the six-step fft is used from the smallest size it supports.
+          for(unsigned int six_step_min_size : {Algo<T>::default_six_step_min_size, 1u}) {
+            algo.six_step_min_size = six_step_min_size;
+            // Bluestein ffts are computed with ffts of the next power of two of 2N
+            double const allowed = 20. * getFFTEpsilon<T>(4 * ceil_power_of_two(ref.N));
+            double const e = verifyAlgo(algo, ref);
+            err = std::max(err, e);
+            max_allowed = std::max(max_allowed, allowed);
+            if(e > allowed) {
+              std::cout << "size " << ref.N << ": relative error " << e << std::endl;
+            }
+            verify(e <= allowed);
+          }
+        }
+        std::cout << (sizeof(T) == 4 ? "float " : "double") << "\t" << simd::toString(instructionSet)
+        << "\t" << (twiddles == Twiddles::Full ? "full  " : "octant") << "\t" << (parallel ? "pool" : "    ")
+        << "\tmax relative error " << err << " (allowed " << max_allowed << ")" << std::endl;
+      }
+    }
+  }
+}
+
+// The best duration of 'f', in microseconds.
+template<typename F>
+double bestMicroseconds(F f) {
+  double best = std::numeric_limits<double>::max();
+  std::chrono::duration<double> total{};
+  // at least 5 runs, and about 0.2 seconds
+  for(int i=0; i<5 || (total.count() < 0.2 && i < 100000); ++i) {
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+    total += elapsed;
+  }
+  return 1e6 * best;
+}
+
+// 2 significant decimals
+double round2(double d) {
+  return std::round(100. * d) / 100.;
+}
+
+template<typename T>
+double measureForward(unsigned int N,
+                      InstructionSet instructionSet = simd::bestInstructionSet(),
+                      Twiddles twiddles = Twiddles::Full,
+                      unsigned int six_step_min_size = Algo<T>::default_six_step_min_size) {
+  ScopedContext<T> context(N, twiddles);
+  Algo<T> algo(context.get());
+  algo.setInstructionSet(instructionSet);
+  algo.six_step_min_size = six_step_min_size;
+  auto const input = toComplex<T>(randomSignal(N));
+  std::vector<std::complex<T>> output(N);
+  return bestMicroseconds([&]() { algo.forward(input.begin(), output, N); });
+}
+
+template<typename T>
+double measureForwardInplace(unsigned int N) {
+  ScopedContext<T> context(N);
+  Algo<T> algo(context.get());
+  auto data = toComplex<T>(randomSignal(N));
+  return bestMicroseconds([&]() { algo.forward_inplace(data.data(), N); });
+}
+
+// The recursive radix-2 fft that the iterative TukeyCooley replaced (forward only).
+template<typename T>
+struct RecursiveFft {
+  RecursiveFft(unsigned int N) : roots(compute_roots_of_unity<T>(N)) {}
+
+  void run(std::complex<T> const * input, std::complex<T> * result, unsigned int N) const {
+    recurse(input, result, N/2, 1);
+  }
+
+private:
+  std::vector<std::complex<T>> const roots;
+
+  void recurse(std::complex<T> const * const __restrict it,
+               std::complex<T> * __restrict result,
+               unsigned int const N,
+               unsigned int const stride) const {
+    if(N==0) {
+      *result = *it;
+      return;
+    }
+    auto const double_stride = 2*stride;
+    auto const half_N = N/2;
+    recurse(it         , result , half_N, double_stride );
+    auto * __restrict result2 = result + N;
+    recurse(it + stride, result2, half_N, double_stride );
+
+    std::complex<T> const * __restrict root_it = roots.data();
+    for(;result != result2; ++result, root_it += stride) {
+      auto const t = result[N] * *root_it;
+      result[N] = result[0] - t;
+      result[0] += t;
+    }
+  }
+};
+
+void measureRecursive() {
+  using T = float;
+  std::cout << std::endl << "iterative fft versus the recursive fft it replaced (float, us):" << std::endl;
+  std::cout << "size\trecursive\titerative scalar\titerative " << simd::toString(simd::bestInstructionSet()) << std::endl;
+  for(unsigned int N = 1024; N <= 65536; N *= 4) {
+    RecursiveFft<T> recursive(N);
+    auto const input = toComplex<T>(randomSignal(N));
+    std::vector<std::complex<T>> output(N);
+    {
+      // the recursive fft is verified too
+      auto const expected = dft({input.begin(), input.end()});
+      recursive.run(input.data(), output.data(), N);
+      verify(relativeError(output.data(), expected.data(), N) <= 20. * getFFTEpsilon<T>(N));
+    }
+    double const recursive_us = bestMicroseconds([&]() { recursive.run(input.data(), output.data(), N); });
+    double const scalar_us = measureForward<T>(N, InstructionSet::Scalar);
+    double const best_us = measureForward<T>(N);
+    std::cout << N << "\t" << round2(recursive_us) << "\t\t" << round2(scalar_us) << " (" << round2(recursive_us / scalar_us) << "x)"
+    << "\t\t" << round2(best_us) << " (" << round2(recursive_us / best_us) << "x)" << std::endl;
+  }
+}
+
+void measureInstructionSets() {
+  std::cout << std::endl << "forward ffts per instruction set (us):" << std::endl;
+  std::cout << "size\t\t";
+  for(auto i : supportedInstructionSets()) {
+    std::cout << "\t" << simd::toString(i);
+  }
+  std::cout << std::endl;
+  for(unsigned int N : {16u, 64u, 1024u, 65536u, 1u << 22}) {
+    std::cout << N << "\tfloat ";
+    for(auto i : supportedInstructionSets()) {
+      std::cout << "\t" << round2(measureForward<float>(N, i));
+    }
+    std::cout << std::endl << N << "\tdouble";
+    for(auto i : supportedInstructionSets()) {
+      std::cout << "\t" << round2(measureForward<double>(N, i));
+    }
+    std::cout << std::endl;
+  }
+}
+
+void measureSmallSizes() {
+  std::cout << std::endl << "small forward ffts (ns):" << std::endl;
+  std::cout << "size\tfloat\tdouble" << std::endl;
+  for(unsigned int N = 2; N <= 128; N *= 2) {
+    std::cout << N << "\t" << round2(1e3 * measureForward<float>(N)) << "\t" << round2(1e3 * measureForward<double>(N)) << std::endl;
+  }
+}
+
+void measureInplace() {
+  std::cout << std::endl << "out-of-place / in-place forward ffts (float, us):" << std::endl;
+  for(unsigned int N : {1u << 16, 1u << 20, 1u << 22}) {
+    std::cout << N << "\t" << round2(measureForward<float>(N)) << "\t" << round2(measureForwardInplace<float>(N)) << std::endl;
+  }
+}
+
+void measureTwiddles() {
+  std::cout << std::endl << "full / octant twiddles (float, forward, us):" << std::endl;
+  for(unsigned int N : {1u << 20, 1u << 22}) {
+    auto const i = simd::bestInstructionSet();
+    std::cout << N << "\t" << round2(measureForward<float>(N, i, Twiddles::Full))
+    << "\t" << round2(measureForward<float>(N, i, Twiddles::Octant)) << std::endl;
+  }
+}
+
+void measureSixStep() {
+  std::cout << std::endl << "TukeyCooley / six-step forward ffts (us):" << std::endl;
+  auto const i = simd::bestInstructionSet();
+  unsigned int const never = std::numeric_limits<unsigned int>::max();
+  for(unsigned int N : {1u << 18, 1u << 20, 1u << 21, 1u << 22, 1u << 23}) {
+    std::cout << N << "\tfloat \t" << round2(measureForward<float>(N, i, Twiddles::Full, never))
+    << "\t" << round2(measureForward<float>(N, i, Twiddles::Full, 1)) << std::endl;
+  }
+  for(unsigned int N : {1u << 22, 1u << 23}) {
+    std::cout << N << "\tdouble\t" << round2(measureForward<double>(N, i, Twiddles::Full, never))
+    << "\t" << round2(measureForward<double>(N, i, Twiddles::Full, 1)) << std::endl;
+  }
+}
+
+void measureOtherSizes() {
+  std::cout << std::endl << "sizes that are not powers of two, versus the next power of two (float, forward, us):" << std::endl;
+  // (mixed-radix sizes close to the next power of two, then far from it)
+  for(unsigned int N : {441u, 960u, 1920u, 1152u, 1280u, 4800u, 9600u, 1009u}) {
+    std::cout << N << (is_mixed_radix_size(N) ? " (mixed radix)" : " (Bluestein)  ") << "\t" << round2(measureForward<float>(N))
+    << "\t" << ceil_power_of_two(N) << "\t" << round2(measureForward<float>(ceil_power_of_two(N))) << std::endl;
+  }
+}
+
+/*
+ Speedup of the parallel mode (see 'Algo_::setThreadPool') relative to one thread without pool,
+ for thread counts up to the number of cores (at least 2, to measure the overhead of the pool), and several grains.
+ */
+void measureScaling() {
+  using T = float;
+  unsigned int const n_cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> thread_counts;
+  for(unsigned int n = 1; n <= std::max(2u, n_cores); n *= 2) {
+    thread_counts.push_back(n);
+  }
+  if(n_cores > 2 && !is_power_of_two(n_cores)) {
+    thread_counts.push_back(n_cores);
+  }
+  std::vector<unsigned int> const grains {1u << 13, 1u << 15, 1u << 17};
+
+  std::cout << std::endl << "parallel forward ffts, speedup relative to no pool (float, " << n_cores << " cores):" << std::endl;
+  for(unsigned int N : {1u << 20, 1u << 22}) {
+    ScopedContext<T> context(N);
+    Algo<T> algo(context.get());
+    auto const input = toComplex<T>(randomSignal(N));
+    std::vector<std::complex<T>> output(N);
+    double const no_pool = bestMicroseconds([&]() { algo.forward(input.begin(), output, N); });
+    std::cout << N << " (" << (N >= algo.six_step_min_size ? "six-step" : "TukeyCooley") << "), no pool: " << round2(no_pool / 1000.) << " ms" << std::endl;
+    std::cout << "threads";
+    for(auto grain : grains) {
+      std::cout << "\tgrain " << grain;
+    }
+    std::cout << std::endl;
+    for(int n_threads : thread_counts) {
+      WorkStealingPool pool(n_threads);
+      std::cout << n_threads;
+      for(auto grain : grains) {
+        algo.setThreadPool(&pool, grain);
+        double const us = bestMicroseconds([&]() { algo.forward(input.begin(), output, N); });
+        std::cout << "\t" << round2(no_pool / us) << "x";
+      }
+      std::cout << std::endl;
+      algo.setThreadPool(nullptr);
+    }
+  }
+}
+
+int main(void) {
+  srand(0); // we use rand() as random number generator and we want reproducible results so we use a fixed seeed.
+
+  std::cout << "verifying results... " << std::endl;
+  {
+    std::vector<Reference> refs;
+    // powers of two (the six-step fft needs at least 1024 elements), mixed-radix sizes, Bluestein sizes
+    for(unsigned int N : {1u, 2u, 4u, 8u, 16u, 32u, 64u, 128u, 256u, 2048u, 4096u,
+                          12u, 60u, 441u, 960u,
+                          97u, 1009u, 2018u}) {
+      refs.push_back(makeReference(N));
+    }
+    WorkStealingPool pool(4);
+    verifyAll<float>(refs, pool);
+    verifyAll<double>(refs, pool);
+  }
+
+  measureRecursive();
+  measureInstructionSets();
+  measureSmallSizes();
+  measureInplace();
+  measureTwiddles();
+  measureSixStep();
+  measureOtherSizes();
+  measureScaling();
+  return 0;
+}
@@ -0,0 +1,78 @@
+
+/*
+ Tunes the ffts of 'GpuFftPlan' for the default device (see 'tuneFft'): for every size, the number of butterflies
+ per work item (hence the workgroup size) and the kernel file of the fastest variant are saved in the tuning file
+ (see 'FftTunings'), which the next 'GpuFftPlan's load, e.g. in main_fft_many_floats_stockham_twiddles.cpp.
+ */
+
+using imajuscule::GpuFftPlan;
+
+int main(void) {
+  using namespace imajuscule;
+  using namespace imajuscule::fft;
+
+  srand(0); // we use rand() as random number generator and we want reproducible results so we use a fixed seeed.
+
+  // Get platform and device information
+  cl_platform_id platform_id = NULL;
+  cl_device_id device_id = NULL;
+  cl_uint ret_num_devices;
+  cl_uint ret_num_platforms;
+  cl_int ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
+  CHECK_CL_ERROR(ret);
+  ret = clGetDeviceIDs( platform_id, CL_DEVICE_TYPE_DEFAULT, 1,
+                       &device_id, &ret_num_devices);
+  CHECK_CL_ERROR(ret);
+
+  // Create an OpenCL context
+  cl_context context = clCreateContext( NULL, 1, &device_id, NULL, NULL, &ret);
+  CHECK_CL_ERROR(ret);
+
+  // Create a command queue
+  cl_command_queue command_queue = clCreateCommandQueue(context, device_id, 0, &ret);
+  CHECK_CL_ERROR(ret);
+
+  std::vector<unsigned int> sizes;
+  for(unsigned int sz=2; GpuFftPlan::fits(device_id, sz); sz *= 2) {
+    sizes.push_back(sz);
+  }
+
+  tuneFfts(context, device_id, sizes);
+
+  std::cout << "size\tbutterflies per work item\tworkgroup size\tkernel (us)\tkernel file" << std::endl;
+  for(auto sz : sizes) {
+    // the plan uses the tuning
+    GpuFftPlan plan(context, device_id, command_queue, sz);
+    auto const & t = plan.getTuning();
+    std::cout << sz << "\t" << t.nButterfliesPerThread << "\t" << plan.getGlobalSize()
+    << "\t" << t.microseconds << "\t" << t.kernel_file << std::endl;
+
+    // the tuned plan computes the same fft as the cpu
+    std::vector<float> input;
+    input.reserve(sz);
+    for(unsigned int i=0; i<sz; ++i) {
+      input.push_back(rand_float(0.f,1.f));
+    }
+    std::vector<std::complex<float>> output(sz);
+    plan.write(input.data());
+    plan.execute();
+    plan.read(output.data());
+    verifyVectorsAreEqual(output, makeRefForwardFft(input), 0.01f);
+  }
+
+  auto const & path = FftTunings::getInstance().getPath();
+  std::cout << std::endl << "tuning file : " << (path.empty() ? std::string("(disabled)") : path) << std::endl;
+
+  // Clean up
+  ret = clFlush(command_queue);
+  CHECK_CL_ERROR(ret);
+  ret = clFinish(command_queue);
+  CHECK_CL_ERROR(ret);
+  ret = clReleaseCommandQueue(command_queue);
+  CHECK_CL_ERROR(ret);
+  KernelRegistry::getInstance().clear(context);
+  ret = clReleaseContext(context);
+  CHECK_CL_ERROR(ret);
+
+  return 0;
+}
@@ -196,30 +196,14 @@ bool withInput(cl_context context,
   return true;
 }
 
-std::string ReplaceString(std::string subject, const std::string& search,
-                          const std::string& replace) {
-  size_t pos = 0;
-  while ((pos = subject.find(search, pos)) != std::string::npos) {
-    subject.replace(pos, search.length(), replace);
-    pos += replace.length();
-  }
-  return subject;
-}
-
 struct ScopedKernel {
   
-  cl_program program;
-  cl_kernel kernel1, kernel2;
+  imajuscule::KernelRegistry::Kernel kernel1, kernel2;
   int nButterfliesPerThread;
 
-  ScopedKernel(cl_context context, cl_device_id device_id, std::string const & kernel_src, size_t const input_size, size_t const nWorkgroups) {
+  ScopedKernel(cl_context context, cl_device_id device_id, size_t const input_size, size_t const nWorkgroups) {
     using namespace imajuscule;
     int const nButterflies = input_size/2;
-    char buf[256];
-    memset(buf, 0, sizeof(buf));
-    snprintf(buf, sizeof(buf), "%a", (T)(-M_PI/nButterflies));
-
-    cl_int ret;
 
     // 2*nButterfliesPerThread must be a multiple of 'nWorkgroups'
     for(nButterfliesPerThread = std::max(1,(int)nWorkgroups/2);;) {
@@ -228,54 +212,19 @@ struct ScopedKernel {
         throw std::runtime_error("the number of local butterflies must be a multiple of the number of groups");
       }
       
-      std::string const replaced_str = ReplaceString(ReplaceString(ReplaceString(ReplaceString(kernel_src,
-                                                                                               "replace_MINUS_PI_over_N_GLOBAL_BUTTERFLIES",
-                                                                                               buf),
-                                                                                 "replace_N_GLOBAL_BUTTERFLIES",
-                                                                                 std::to_string(nButterflies)),
-                                                                   "replace_LOG2_N_GLOBAL_BUTTERFLIES",
-                                                                   std::to_string(power_of_two_exponent(nButterflies))),
-                                                     "replace_N_LOCAL_BUTTERFLIES",
-                                                     std::to_string(nButterfliesPerThread));
-      size_t const replaced_source_size = replaced_str.size();
-      const char * rep_src = replaced_str.data();
-
-      // Create a program from the kernel source
-      program = clCreateProgramWithSource(context, 1,
-                                          (const char **)&rep_src, (const size_t *)&replaced_source_size, &ret);
-      CHECK_CL_ERROR(ret);
-      
-      // Build the program
-      ret = clBuildProgram(program, 1, &device_id,
-                           // -cl-fast-relaxed-math makes the twiddle fators computation a little faster
-                           // but a little less accurate too.
-                           "-I /Users/Olivier/Dev/gpgpu/ -cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math",
-                           NULL, NULL);
-      CHECK_CL_ERROR(ret);
-      
-      // Create the OpenCL kernel
-      kernel1 = clCreateKernel(program, "first_butterflies", &ret);
-      CHECK_CL_ERROR(ret);
-      kernel2 = clCreateKernel(program, "last_butterflies", &ret);
-      CHECK_CL_ERROR(ret);
+      // The variant is built the first time it is used (or its binary is loaded from the cache, see 'ProgramCache'),
+      // then it is kept in memory by the registry.
+      auto const variant = fftVariant(kernel_file, nButterflies, nButterfliesPerThread);
+      kernel1 = KernelRegistry::getInstance().get(context, device_id, variant, "first_butterflies");
+      kernel2 = KernelRegistry::getInstance().get(context, device_id, variant, "last_butterflies");
 
-      size_t workgroup_max_sz1, workgroup_max_sz2;
-      ret = clGetKernelWorkGroupInfo(kernel1,
-                                     device_id,
-                                     CL_KERNEL_WORK_GROUP_SIZE,
-                                     sizeof(workgroup_max_sz1), &workgroup_max_sz1, NULL);
-      CHECK_CL_ERROR(ret);
-      ret = clGetKernelWorkGroupInfo(kernel2,
-                                     device_id,
-                                     CL_KERNEL_WORK_GROUP_SIZE,
-                                     sizeof(workgroup_max_sz2), &workgroup_max_sz2, NULL);
-      CHECK_CL_ERROR(ret);
+      size_t const workgroup_max_sz1 = kernel1.getWorkGroupMaxSize();
+      size_t const workgroup_max_sz2 = kernel2.getWorkGroupMaxSize();
       verify(workgroup_max_sz2 == workgroup_max_sz1);
       size_t workgroup_max_sz = std::min(workgroup_max_sz1, workgroup_max_sz2);
       std::cout << "workgroup max size: " << workgroup_max_sz << " for " << nButterfliesPerThread << " butterfly per thread." << std::endl;
       
       if(nButterflies > nButterfliesPerThread * workgroup_max_sz * nWorkgroups) {
-        release();
         // To estimate the next value of 'nButterfliesPerThread',
         // we make the reasonnable assumption that "work group max size"
         // won't be bigger if we increase 'nButterfliesPerThread':
@@ -285,24 +234,8 @@ struct ScopedKernel {
       break;
     }
   }
-  
-  ~ScopedKernel() {
-    release();
-  }
 
 private:
-  void release() {
-    cl_int ret = clReleaseKernel(kernel1);
-    CHECK_CL_ERROR(ret);
-    ret = clReleaseKernel(kernel2);
-    CHECK_CL_ERROR(ret);
-    ret = clReleaseProgram(program);
-    CHECK_CL_ERROR(ret);
-    kernel1 = 0;
-    kernel2 = 0;
-    program = 0;
-  }
-  
   ScopedKernel(const ScopedKernel&) = delete;
   ScopedKernel& operator=(const ScopedKernel&) = delete;
   ScopedKernel(ScopedKernel&&) = delete;
@@ -338,9 +271,6 @@ int main(void) {
                                                         CL_QUEUE_PROFILING_ENABLE, &ret);
   CHECK_CL_ERROR(ret);
 
-  // read the kernel code
-  auto kernel_src = read_kernel(kernel_file);
-
   // Note that if the GPU has not enough memory available, it will crash.
   // On my system, the limit is reached at size 134217728.
   //
@@ -361,13 +291,13 @@ int main(void) {
     int const minNWorkgroups = 1 + (2 * input.size() * sizeof(std::complex<T>) - 1) / local_mem_sz;
     std::cout << "using " << minNWorkgroups << " workgroup(s)." << std::endl;
 
-    const ScopedKernel sc(context, device_id, kernel_src, input.size(), minNWorkgroups);
+    const ScopedKernel sc(context, device_id, input.size(), minNWorkgroups);
     
     if(!withInput(context,
                   device_id,
                   command_queue,
-                  sc.kernel1,
-                  sc.kernel2,
+                  sc.kernel1.get(),
+                  sc.kernel2.get(),
                   sc.nButterfliesPerThread,
                   input,
                   minNWorkgroups,
@@ -384,6 +314,7 @@ int main(void) {
   CHECK_CL_ERROR(ret);
   ret = clReleaseCommandQueue(command_queue);
   CHECK_CL_ERROR(ret);
+  imajuscule::KernelRegistry::getInstance().clear(context);
   ret = clReleaseContext(context);
   CHECK_CL_ERROR(ret);
 
@@ -134,28 +134,15 @@ void withInput(cl_context context,
   CHECK_CL_ERROR(ret);
 }
 
-std::string ReplaceString(std::string subject, const std::string& search,
-                          const std::string& replace) {
-  size_t pos = 0;
-  while ((pos = subject.find(search, pos)) != std::string::npos) {
-    subject.replace(pos, search.length(), replace);
-    pos += replace.length();
-  }
-  return subject;
-}
-
 struct ScopedKernel {
   
-  cl_program program;
-  cl_kernel kernel;
+  imajuscule::KernelRegistry::Kernel kernel;
   int nButterfliesPerThread;
 
-  ScopedKernel(cl_context context, cl_device_id device_id, std::string const & kernel_src, size_t const input_size) {
+  ScopedKernel(cl_context context, cl_device_id device_id, size_t const input_size) {
     using namespace imajuscule;
     int const nButterflies = input_size/2;
 
-    cl_int ret;
-
     // TODO if local memory can hold the output, use the kernel with local memory,
     // else use the kernel with global memory
     // We could think of a mixed approach where we compute the fft by parts:
@@ -165,51 +152,16 @@ struct ScopedKernel {
     //   do the writeback of the omitted portion
 
     for(nButterfliesPerThread = 1;;) {
-      char buf[256];
-      memset(buf, 0, sizeof(buf));
-      snprintf(buf, sizeof(buf), "%a", (float)(-M_PI/nButterflies));
-      
-      std::string const replaced_str = ReplaceString(ReplaceString(ReplaceString(ReplaceString(ReplaceString(kernel_src,
-                                                                                                             "replace_INPUT_SIZE",
-                                                                                                             std::to_string(input_size)),
-                                                                                               "replace_MINUS_PI_over_N_GLOBAL_BUTTERFLIES",
-                                                                                               buf),
-                                                                                 "replace_N_GLOBAL_BUTTERFLIES",
-                                                                                 std::to_string(nButterflies)),
-                                                                   "replace_LOG2_N_GLOBAL_BUTTERFLIES",
-                                                                   std::to_string(power_of_two_exponent(nButterflies))),
-                                                     "replace_N_LOCAL_BUTTERFLIES",
-                                                     std::to_string(nButterfliesPerThread));
-      size_t const replaced_source_size = replaced_str.size();
-      const char * rep_src = replaced_str.data();
-
-      // Create a program from the kernel source
-      program = clCreateProgramWithSource(context, 1,
-                                          (const char **)&rep_src, (const size_t *)&replaced_source_size, &ret);
-      CHECK_CL_ERROR(ret);
-      
-      // Build the program
-      ret = clBuildProgram(program, 1, &device_id,
-                           // -cl-fast-relaxed-math makes the twiddle fators computation a little faster
-                           // but a little less accurate too.
-                           "-I /Users/Olivier/Dev/gpgpu/ -cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math",
-                           NULL, NULL);
-      CHECK_CL_ERROR(ret);
-      
-      // Create the OpenCL kernel
-      kernel = clCreateKernel(program, "kernel_func", &ret);
-      CHECK_CL_ERROR(ret);
+      // The variant is built the first time it is used (or its binary is loaded from the cache, see 'ProgramCache'),
+      // then it is kept in memory by the registry.
+      kernel = KernelRegistry::getInstance().get(context, device_id,
+                                                 fftVariant(kernel_file, nButterflies, nButterfliesPerThread),
+                                                 "kernel_func");
       
-      size_t workgroup_max_sz;
-      ret = clGetKernelWorkGroupInfo(kernel,
-                                     device_id,
-                                     CL_KERNEL_WORK_GROUP_SIZE,
-                                     sizeof(workgroup_max_sz), &workgroup_max_sz, NULL);
-      CHECK_CL_ERROR(ret);
+      size_t const workgroup_max_sz = kernel.getWorkGroupMaxSize();
       std::cout << "workgroup max size: " << workgroup_max_sz << " for " << nButterfliesPerThread << " butterfly per thread." << std::endl;
       
       if(nButterflies > nButterfliesPerThread * workgroup_max_sz) {
-        release();
         // To estimate the next value of 'nButterfliesPerThread',
         // we make the reasonnable assumption that "work group max size"
         // won't be bigger if we increase 'nButterfliesPerThread':
@@ -219,21 +171,8 @@ struct ScopedKernel {
       break;
     }
   }
-  
-  ~ScopedKernel() {
-    release();
-  }
 
 private:
-  void release() {
-    cl_int ret = clReleaseKernel(kernel);
-    CHECK_CL_ERROR(ret);
-    ret = clReleaseProgram(program);
-    CHECK_CL_ERROR(ret);
-    kernel = 0;
-    program = 0;
-  }
-  
   ScopedKernel(const ScopedKernel&) = delete;
   ScopedKernel& operator=(const ScopedKernel&) = delete;
   ScopedKernel(ScopedKernel&&) = delete;
@@ -263,9 +202,6 @@ int main(void) {
                                                         CL_QUEUE_PROFILING_ENABLE, &ret);
   CHECK_CL_ERROR(ret);
 
-  // read the kernel code
-  auto kernel_src = read_kernel(kernel_file);
-
   // Note that if the GPU has not enough memory available, it will crash.
   // On my system, the limit is reached at size 134217728.
   for(int sz=2; sz < 10000000; sz *= 2) {
@@ -278,12 +214,12 @@ int main(void) {
       input.push_back(rand_float(0.f,1.f));
     }
     
-    const ScopedKernel sc(context, device_id, kernel_src, input.size());
+    const ScopedKernel sc(context, device_id, input.size());
 
     withInput(context,
               device_id,
               command_queue,
-              sc.kernel,
+              sc.kernel.get(),
               sc.nButterfliesPerThread,
               input,
               true // set this to true to verify results
@@ -297,6 +233,7 @@ int main(void) {
   CHECK_CL_ERROR(ret);
   ret = clReleaseCommandQueue(command_queue);
   CHECK_CL_ERROR(ret);
+  imajuscule::KernelRegistry::getInstance().clear(context);
   ret = clReleaseContext(context);
   CHECK_CL_ERROR(ret);
 
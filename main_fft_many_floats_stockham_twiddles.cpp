@@ -3,13 +3,15 @@
 //                                                                                                        // Times for 4096 fft //
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-constexpr auto kernel_file = "vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles.cl";   // 155
+// the kernel is vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles.cl (see 'GpuFftPlan')   // 155
 
-bool withInput(cl_context context,
-               cl_device_id device_id,
-               cl_command_queue command_queue,
-               cl_kernel kernel,
-               int nButterfliesPerThread,
+using imajuscule::GpuFftPlan;
+
+/*
+ The program, the kernel and the buffers are created once per size by 'GpuFftPlan',
+ so the ffts of the measure loops only enqueue the kernel (and the transfers, for the round trips).
+ */
+bool withInput(GpuFftPlan & plan,
                std::vector<float> const & input,
                bool verifyResults
                )
@@ -17,20 +19,11 @@ bool withInput(cl_context context,
   using namespace imajuscule;
   using namespace imajuscule::fft;
 
-  verify(is_power_of_two(input.size()) && input.size() >= 2);
+  verify(input.size() == plan.getSize());
   
   std::vector<std::complex<float>> output;
   output.resize(input.size());
   
-  cl_ulong local_mem_sz;
-  cl_int ret = clGetDeviceInfo(device_id,
-                               CL_DEVICE_LOCAL_MEM_SIZE,
-                               sizeof(local_mem_sz), &local_mem_sz, NULL);
-  if(local_mem_sz < 2 * output.size() * sizeof(decltype(output[0]))) {
-    std::cout << "not enough local memory on the device!" << std::endl;
-    return false;
-  }
-
   // Our GPU kernel doesn't do bit-reversal of the input, so this should be done on the host.
   // In this scope, we verify that when the input is bit-reversed prior to being fed to 'cpu_func',
   // we get the expected result:
@@ -45,32 +38,11 @@ bool withInput(cl_context context,
     std::cout << "- ok" << std::endl;
   }
   
-  // Create memory buffers on the device for each vector
-  cl_mem input_mem_obj = clCreateBuffer(context, CL_MEM_READ_ONLY,
-                                        input.size() * sizeof(decltype(input[0])), NULL, &ret);
-  CHECK_CL_ERROR(ret);
-  cl_mem output_mem_obj = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-                                         output.size() * sizeof(decltype(output[0])), NULL, &ret);
-  CHECK_CL_ERROR(ret);
-  
   // Copy the input to its memory buffers.
   // This can crash if the GPU has not enough memory.
-  ret = clEnqueueWriteBuffer(command_queue, input_mem_obj, CL_TRUE, 0,
-                             input.size() * sizeof(decltype(input[0])), &input[0], 0, NULL, NULL);
-  CHECK_CL_ERROR(ret);
-  
-  // Set the arguments of the kernel
-  ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&input_mem_obj);
-  CHECK_CL_ERROR(ret);
-  ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&output_mem_obj);
-  CHECK_CL_ERROR(ret);
-  ret = clSetKernelArg(kernel, 2, 2*sizeof(float) * 2*input.size(), NULL); // local memory
-  CHECK_CL_ERROR(ret);
+  plan.write(input.data(), true);
 
-  // Execute the OpenCL kernel
-  size_t global_item_size = input.size()/(2*nButterfliesPerThread);
-  size_t local_item_size = global_item_size;
-  std::cout << "run kernels using global size : " << global_item_size << std::endl;
+  std::cout << "run kernels using global size : " << plan.getGlobalSize() << std::endl;
   
   double elapsed = 0.;
 
@@ -79,13 +51,9 @@ bool withInput(cl_context context,
   for(int i=0; i<nSkipIterations+nIterations; ++i)
   {
     cl_event event;
-    ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL,
-                                 &global_item_size,
-                                 &local_item_size,
-                                 0, NULL, &event);
-    CHECK_CL_ERROR(ret);
+    plan.execute(0, NULL, &event);
     
-    ret = clWaitForEvents(1, &event);
+    cl_int ret = clWaitForEvents(1, &event);
     CHECK_CL_ERROR(ret);
 
     cl_ulong time_start, time_end;
@@ -93,6 +61,8 @@ bool withInput(cl_context context,
     CHECK_CL_ERROR(ret);
     ret = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
     CHECK_CL_ERROR(ret);
+    ret = clReleaseEvent(event);
+    CHECK_CL_ERROR(ret);
 
     if(i>=nSkipIterations) {
       elapsed += time_end - time_start;
@@ -100,11 +70,21 @@ bool withInput(cl_context context,
   }
   std::cout << "avg kernel duration (us) : " << (int)(elapsed/(double)nIterations)/1000 << std::endl;
 
-  // Read the memory buffer output_mem_obj on the device to the local variable output
-  ret = clEnqueueReadBuffer(command_queue, output_mem_obj, CL_TRUE, 0,
-                            output.size() * sizeof(decltype(output[0])), &output[0], 0, NULL, NULL);
-  
-  CHECK_CL_ERROR(ret);
+  // the round trips: write the input, fft, read the output.
+  {
+    constexpr int nRoundTrips = 300;
+    auto const start = std::chrono::steady_clock::now();
+    for(int i=0; i<nRoundTrips; ++i) {
+      plan.write(input.data());
+      plan.execute();
+      plan.read(output.data());
+    }
+    std::chrono::duration<double> const d = std::chrono::steady_clock::now() - start;
+    std::cout << "avg round trip duration (us) : " << (int)(1e6 * d.count() / nRoundTrips) << std::endl;
+  }
+
+  // Read the output buffer of the device to the local variable output
+  plan.read(output.data());
 
   if(verifyResults) {
     std::cout << "verifying results... " << std::endl;
@@ -122,119 +102,9 @@ bool withInput(cl_context context,
                           );
   }
   
-  // Cleanup
-  ret = clReleaseMemObject(input_mem_obj);
-  CHECK_CL_ERROR(ret);
-  ret = clReleaseMemObject(output_mem_obj);
-  CHECK_CL_ERROR(ret);
-  
   return true;
 }
 
-std::string ReplaceString(std::string subject, const std::string& search,
-                          const std::string& replace) {
-  size_t pos = 0;
-  while ((pos = subject.find(search, pos)) != std::string::npos) {
-    subject.replace(pos, search.length(), replace);
-    pos += replace.length();
-  }
-  return subject;
-}
-
-struct ScopedKernel {
-  
-  cl_program program;
-  cl_kernel kernel;
-  int nButterfliesPerThread;
-
-  ScopedKernel(cl_context context, cl_device_id device_id, std::string const & kernel_src, size_t const input_size) {
-    using namespace imajuscule;
-    int const nButterflies = input_size/2;
-
-    cl_int ret;
-
-    // TODO if local memory can hold the output, use the kernel with local memory,
-    // else use the kernel with global memory
-    // We could think of a mixed approach where we compute the fft by parts:
-    //   do the first levels by blocks, using local memory + writeback,
-    //   omit the last writeback, use the local memory + global memory for
-    //     the other levels
-    //   do the writeback of the omitted portion
-
-    for(nButterfliesPerThread = 1;;) {
-      char buf[256];
-      memset(buf, 0, sizeof(buf));
-      snprintf(buf, sizeof(buf), "%a", (float)(-M_PI/nButterflies));
-      
-      std::string const replaced_str = ReplaceString(ReplaceString(ReplaceString(ReplaceString(kernel_src,
-                                                                                               "replace_MINUS_PI_over_N_GLOBAL_BUTTERFLIES",
-                                                                                               buf),
-                                                                                 "replace_N_GLOBAL_BUTTERFLIES",
-                                                                                 std::to_string(nButterflies)),
-                                                                   "replace_LOG2_N_GLOBAL_BUTTERFLIES",
-                                                                   std::to_string(power_of_two_exponent(nButterflies))),
-                                                     "replace_N_LOCAL_BUTTERFLIES",
-                                                     std::to_string(nButterfliesPerThread));
-      size_t const replaced_source_size = replaced_str.size();
-      const char * rep_src = replaced_str.data();
-
-      // Create a program from the kernel source
-      program = clCreateProgramWithSource(context, 1,
-                                          (const char **)&rep_src, (const size_t *)&replaced_source_size, &ret);
-      CHECK_CL_ERROR(ret);
-      
-      // Build the program
-      ret = clBuildProgram(program, 1, &device_id,
-                           // -cl-fast-relaxed-math makes the twiddle fators computation a little faster
-                           // but a little less accurate too.
-                           "-I /Users/Olivier/Dev/gpgpu/ -cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math",
-                           NULL, NULL);
-      CHECK_CL_ERROR(ret);
-      
-      // Create the OpenCL kernel
-      kernel = clCreateKernel(program, "kernel_func", &ret);
-      CHECK_CL_ERROR(ret);
-      
-      size_t workgroup_max_sz;
-      ret = clGetKernelWorkGroupInfo(kernel,
-                                     device_id,
-                                     CL_KERNEL_WORK_GROUP_SIZE,
-                                     sizeof(workgroup_max_sz), &workgroup_max_sz, NULL);
-      CHECK_CL_ERROR(ret);
-      std::cout << "workgroup max size: " << workgroup_max_sz << " for " << nButterfliesPerThread << " butterfly per thread." << std::endl;
-      
-      if(nButterflies > nButterfliesPerThread * workgroup_max_sz) {
-        release();
-        // To estimate the next value of 'nButterfliesPerThread',
-        // we make the reasonnable assumption that "work group max size"
-        // won't be bigger if we increase 'nButterfliesPerThread':
-        nButterfliesPerThread = nButterflies / workgroup_max_sz;
-        continue;
-      }
-      break;
-    }
-  }
-  
-  ~ScopedKernel() {
-    release();
-  }
-
-private:
-  void release() {
-    cl_int ret = clReleaseKernel(kernel);
-    CHECK_CL_ERROR(ret);
-    ret = clReleaseProgram(program);
-    CHECK_CL_ERROR(ret);
-    kernel = 0;
-    program = 0;
-  }
-  
-  ScopedKernel(const ScopedKernel&) = delete;
-  ScopedKernel& operator=(const ScopedKernel&) = delete;
-  ScopedKernel(ScopedKernel&&) = delete;
-  ScopedKernel& operator=(ScopedKernel&&) = delete;
-};
-
 int main(void) {
   srand(0); // we use rand() as random number generator and we want reproducible results so we use a fixed seeed.
   
@@ -258,8 +128,8 @@ int main(void) {
                                                         CL_QUEUE_PROFILING_ENABLE, &ret);
   CHECK_CL_ERROR(ret);
 
-  // read the kernel code
-  auto kernel_src = read_kernel(kernel_file);
+  std::chrono::duration<double> plans_creation{};
+  std::vector<int> sizes;
 
   // Note that if the GPU has not enough memory available, it will crash.
   // On my system, the limit is reached at size 134217728.
@@ -273,20 +143,42 @@ int main(void) {
       input.push_back(rand_float(0.f,1.f));
     }
     
-    const ScopedKernel sc(context, device_id, kernel_src, input.size());
-
-    if(!withInput(context,
-              device_id,
-              command_queue,
-              sc.kernel,
-              sc.nButterfliesPerThread,
-              input,
-              true // set this to true to verify results
+    if(!GpuFftPlan::fits(device_id, input.size())) {
+      std::cout << "not enough local memory on the device!" << std::endl;
+      break;
+    }
+    // the program is compiled only at the first run, it is then loaded from the binary cache (see 'ProgramCache').
+    auto const start = std::chrono::steady_clock::now();
+    GpuFftPlan plan(context, device_id, command_queue, input.size());
+    std::chrono::duration<double> const creation = std::chrono::steady_clock::now() - start;
+    plans_creation += creation;
+    std::cout << "plan creation (ms) : " << (int)(1e3 * creation.count()) << std::endl;
+    std::cout << "using " << plan.getButterfliesPerThread() << " butterfly per thread." << std::endl;
+
+    if(!withInput(plan,
+                  input,
+                  true // set this to true to verify results
                   )) {
       break;
     }
+    sizes.push_back(sz);
   }
+
+  // switching back to a size that was used before is free: the kernel is kept in memory by the 'KernelRegistry'
+  auto const built = imajuscule::KernelRegistry::getInstance().countBuilt();
+  auto const start = std::chrono::steady_clock::now();
+  for(auto sz : sizes) {
+    GpuFftPlan plan(context, device_id, command_queue, sz);
+  }
+  std::chrono::duration<double> const recreation = std::chrono::steady_clock::now() - start;
+  verify(built == imajuscule::KernelRegistry::getInstance().countBuilt());
   
+  auto const & cache = imajuscule::ProgramCache::getInstance();
+  std::cout << std::endl << "plans creation (ms) : " << (int)(1e3 * plans_creation.count())
+  << ", programs compiled : " << cache.countCompiled()
+  << ", loaded from the cache (" << cache.getDirectory() << ") : " << cache.countCached() << std::endl;
+  std::cout << "plans re-creation (ms) : " << (int)(1e3 * recreation.count()) << std::endl;
+
   // Clean up
   ret = clFlush(command_queue);
   CHECK_CL_ERROR(ret);
@@ -294,6 +186,7 @@ int main(void) {
   CHECK_CL_ERROR(ret);
   ret = clReleaseCommandQueue(command_queue);
   CHECK_CL_ERROR(ret);
+  imajuscule::KernelRegistry::getInstance().clear(context);
   ret = clReleaseContext(context);
   CHECK_CL_ERROR(ret);
 
@@ -0,0 +1,237 @@
+
+/*
+ * A cache of the binaries of the OpenCL programs, on disk, so that a program is compiled
+ * only the first time it is built (building a program can take hundreds of milliseconds).
+ */
+namespace imajuscule {
+
+  // Returns the string info 'param' of 'device' (including the terminating null character).
+  inline std::string deviceString(cl_device_id device, cl_device_info param) {
+    size_t sz;
+    cl_int ret = clGetDeviceInfo(device, param, 0, NULL, &sz);
+    CHECK_CL_ERROR(ret);
+    std::string s(sz, '\0');
+    ret = clGetDeviceInfo(device, param, sz, &s[0], NULL);
+    CHECK_CL_ERROR(ret);
+    return s;
+  }
+
+  // Returns the string info 'param' of the platform of 'device' (including the terminating null character).
+  inline std::string platformString(cl_device_id device, cl_platform_info param) {
+    cl_platform_id platform;
+    cl_int ret = clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+    CHECK_CL_ERROR(ret);
+    size_t sz;
+    ret = clGetPlatformInfo(platform, param, 0, NULL, &sz);
+    CHECK_CL_ERROR(ret);
+    std::string s(sz, '\0');
+    ret = clGetPlatformInfo(platform, param, sz, &s[0], NULL);
+    CHECK_CL_ERROR(ret);
+    return s;
+  }
+
+  /*
+   * The binaries are stored in one file per program, named after a hash of:
+   * - the source of the program, and of the files it includes (with #include "...", relatively to 'src_root()'),
+   * - the build options,
+   * - the device, its driver and its platform.
+   *
+   * The directory is the environment variable GPGPU_CL_CACHE_DIR if it is set (an empty value disables the cache),
+   * else $XDG_CACHE_HOME/gpgpu or $HOME/.cache/gpgpu.
+   *
+   * A binary that can't be loaded or built (e.g. a corrupt file) is replaced by the binary of the source.
+   */
+  struct ProgramCache {
+    static ProgramCache & getInstance() {
+      static ProgramCache c;
+      return c;
+    }
+
+    // An empty directory disables the cache. Not thread-safe: call it before building programs.
+    void setDirectory(std::string d) { dir = std::move(d); }
+    std::string const & getDirectory() const { return dir; }
+
+    // The number of programs built from their source, and from a cached binary.
+    unsigned int countCompiled() const { return compiled; }
+    unsigned int countCached() const { return cached; }
+
+    cl_program build(cl_context context, cl_device_id device, std::string const & source, std::string const & options) {
+      if(dir.empty()) {
+        ++compiled;
+        return buildSource(context, device, source, options);
+      }
+      auto const key = makeKey(device, source, options);
+      std::string const path = dir + "/" + toHex(hash(key, fnv_offset)) + ".bin";
+      // a second hash, stored in the file, makes collisions of file names harmless.
+      uint64_t const check = hash(key, fnv_offset_check);
+
+      if(auto program = buildBinary(context, device, path, check, options)) {
+        ++cached;
+        return program;
+      }
+      ++compiled;
+      cl_program program = buildSource(context, device, source, options);
+      store(program, path, check);
+      return program;
+    }
+
+  private:
+    ProgramCache() {
+      if(char const * d = getenv("GPGPU_CL_CACHE_DIR")) {
+        dir = d;
+        makeDirectories(dir);
+      }
+      else if(char const * d = getenv("XDG_CACHE_HOME")) {
+        dir = std::string(d) + "/gpgpu";
+        makeDirectories(dir);
+      }
+      else if(char const * d = getenv("HOME")) {
+        dir = std::string(d) + "/.cache/gpgpu";
+        makeDirectories(dir);
+      }
+    }
+
+    std::string dir;
+    std::atomic<unsigned int> compiled{0};
+    std::atomic<unsigned int> cached{0};
+
+    static constexpr uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+    static constexpr uint64_t fnv_offset_check = 0x84222325cbf29ce4ULL;
+
+    // FNV-1a
+    static uint64_t hash(std::string const & s, uint64_t h) {
+      for(unsigned char c : s) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+      }
+      return h;
+    }
+
+    static std::string toHex(uint64_t h) {
+      char buf[17];
+      snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+      return buf;
+    }
+
+    static void makeDirectories(std::string const & d) {
+      for(size_t pos = d.find('/', 1); ; pos = d.find('/', pos + 1)) {
+        mkdir(d.substr(0, pos).c_str(), 0755); // fails when it exists
+        if(pos == std::string::npos) {
+          return;
+        }
+      }
+    }
+
+    // appends the contents of the files included by 'source' (recursively)
+    static void appendIncludes(std::string const & source, std::string & key, std::unordered_set<std::string> & visited) {
+      static std::string const directive = "#include \"";
+      for(size_t pos = source.find(directive); pos != std::string::npos; pos = source.find(directive, pos + 1)) {
+        size_t const begin = pos + directive.size();
+        size_t const end = source.find('"', begin);
+        if(end == std::string::npos) {
+          return;
+        }
+        std::string const file = source.substr(begin, end - begin);
+        if(!visited.insert(file).second) {
+          continue;
+        }
+        std::string contents;
+        try {
+          get_file_contents(fullpath(file), contents);
+        }
+        catch(...) {
+          // the compiler will report it
+        }
+        key += '\0' + file + '\0' + contents;
+        appendIncludes(contents, key, visited);
+      }
+    }
+
+    static std::string makeKey(cl_device_id device, std::string const & source, std::string const & options) {
+      std::string key = source;
+      std::unordered_set<std::string> visited;
+      appendIncludes(source, key, visited);
+      key += '\0' + options;
+      for(auto param : {CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION, CL_DRIVER_VERSION}) {
+        key += '\0' + deviceString(device, param);
+      }
+      for(auto param : {CL_PLATFORM_NAME, CL_PLATFORM_VERSION}) {
+        key += '\0' + platformString(device, param);
+      }
+      return key;
+    }
+
+    static cl_program buildSource(cl_context context, cl_device_id device, std::string const & source, std::string const & options) {
+      cl_int ret;
+      char const * src = source.c_str();
+      size_t const src_size = source.size();
+      cl_program program = clCreateProgramWithSource(context, 1, &src, &src_size, &ret);
+      CHECK_CL_ERROR(ret);
+      ret = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+      CHECK_CL_ERROR(ret);
+      return program;
+    }
+
+    // Returns 0 if the binary is not in the cache, or if it can't be used.
+    static cl_program buildBinary(cl_context context, cl_device_id device,
+                                  std::string const & path, uint64_t check, std::string const & options) {
+      std::string contents;
+      try {
+        get_file_contents(path, contents);
+      }
+      catch(...) {
+        return 0;
+      }
+      if(contents.size() <= sizeof(check) || memcmp(contents.data(), &check, sizeof(check))) {
+        return 0;
+      }
+      auto const * binary = reinterpret_cast<unsigned char const *>(contents.data() + sizeof(check));
+      size_t const binary_size = contents.size() - sizeof(check);
+      cl_int status, ret;
+      cl_program program = clCreateProgramWithBinary(context, 1, &device, &binary_size, &binary, &status, &ret);
+      if(ret != CL_SUCCESS) {
+        return 0;
+      }
+      if(status != CL_SUCCESS ||
+         clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return 0;
+      }
+      return program;
+    }
+
+    static void store(cl_program program, std::string const & path, uint64_t check) {
+      size_t binary_size;
+      cl_int ret = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL);
+      CHECK_CL_ERROR(ret);
+      if(!binary_size) {
+        return;
+      }
+      std::vector<unsigned char> binary(binary_size);
+      unsigned char * binaries[1] = {binary.data()};
+      ret = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL);
+      CHECK_CL_ERROR(ret);
+
+      // written in a temporary file, then renamed, so that a concurrent process never reads a partial file.
+      std::string const tmp = path + "." + std::to_string(getpid()) + ".tmp";
+      {
+        std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<char const *>(&check), sizeof(check));
+        out.write(reinterpret_cast<char const *>(binary.data()), binary.size());
+        if(!out) {
+          // the cache is optional
+          out.close();
+          std::remove(tmp.c_str());
+          return;
+        }
+      }
+      std::rename(tmp.c_str(), path.c_str());
+    }
+  };
+
+  // Returns the program built for 'device' from 'source' with 'options' (using the binary cache, see 'ProgramCache').
+  inline cl_program buildProgram(cl_context context, cl_device_id device, std::string const & source, std::string const & options) {
+    return ProgramCache::getInstance().build(context, device, source, options);
+  }
+
+} // NS imajuscule
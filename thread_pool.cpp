@@ -0,0 +1,170 @@
+
+/*
+ A work-stealing thread pool, used to parallelize large cpu ffts.
+
+ Every worker has its own queue of tasks: a worker pushes and pops tasks at the back
+ of its own queue, and when it is empty, it steals tasks at the front of the queue of another worker
+ (tasks at the front are the oldest, hence the biggest ones when ranges are split recursively).
+
+ The thread calling 'parallel_for' participates to the computation until it is done,
+ so 'parallel_for' can be nested.
+ */
+struct WorkStealingPool {
+  using Task = std::function<void()>;
+
+  WorkStealingPool(int nThreads = std::thread::hardware_concurrency())
+  : queues(std::max(1, nThreads))
+  {
+    // The thread calling 'parallel_for' is one of the threads.
+    for(int i=1; i<static_cast<int>(queues.size()); ++i) {
+      workers.emplace_back([this, i]() { work(i); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> l(sleep_mutex);
+      stop = true;
+    }
+    sleep_cv.notify_all();
+    for(auto & w : workers) {
+      w.join();
+    }
+  }
+
+  int countThreads() const { return queues.size(); }
+
+  /*
+   Calls f(b, e) on subranges [b, e) covering [begin, end),
+   where subranges are at least 'grain' long (except if [begin, end) is shorter),
+   and returns when all calls have returned.
+   */
+  template<typename F>
+  void parallel_for(unsigned int const begin,
+                    unsigned int const end,
+                    unsigned int const grain,
+                    F const & f) {
+    std::atomic<unsigned int> pending(0);
+    split(begin, end, std::max(1u, grain), f, pending);
+    while(pending.load(std::memory_order_acquire)) {
+      if(!runOneTask()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<Queue> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_cv;
+  std::atomic<int> count_queued{0};
+  bool stop = false;
+
+  struct ThreadIdentity {
+    WorkStealingPool const * pool = nullptr;
+    int index = 0;
+  };
+
+  // the pool of which the current thread is a worker, if any.
+  static ThreadIdentity & thread_identity() {
+    thread_local ThreadIdentity identity;
+    return identity;
+  }
+
+  // index of the queue of the current thread.
+  int queueIndex() const {
+    auto const & id = thread_identity();
+    if(id.pool != this) {
+      // threads not belonging to the pool use the first queue.
+      return 0;
+    }
+    return id.index;
+  }
+
+  template<typename F>
+  void split(unsigned int begin,
+             unsigned int end,
+             unsigned int const grain,
+             F const & f,
+             std::atomic<unsigned int> & pending) {
+    // the upper halves are pushed as tasks, the lower half is computed by this thread.
+    while(end - begin >= 2*grain) {
+      unsigned int const mid = begin + (end - begin)/2;
+      pending.fetch_add(1, std::memory_order_relaxed);
+      push([this, mid, end, grain, &f, &pending]() {
+        split(mid, end, grain, f, pending);
+        pending.fetch_sub(1, std::memory_order_release);
+      });
+      end = mid;
+    }
+    f(begin, end);
+  }
+
+  void push(Task t) {
+    auto & q = queues[queueIndex()];
+    {
+      std::lock_guard<std::mutex> l(q.mutex);
+      q.tasks.push_back(std::move(t));
+    }
+    {
+      // so that the notification is not lost if a worker is about to wait.
+      std::lock_guard<std::mutex> l(sleep_mutex);
+      ++count_queued;
+    }
+    sleep_cv.notify_one();
+  }
+
+  bool runOneTask() {
+    Task t;
+    int const n = queues.size();
+    int const own = queueIndex();
+    {
+      auto & q = queues[own];
+      std::lock_guard<std::mutex> l(q.mutex);
+      if(!q.tasks.empty()) {
+        t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+      }
+    }
+    for(int i=1; !t && i<n; ++i) {
+      auto & q = queues[(own+i) % n];
+      std::lock_guard<std::mutex> l(q.mutex);
+      if(!q.tasks.empty()) {
+        t = std::move(q.tasks.front());
+        q.tasks.pop_front();
+      }
+    }
+    if(!t) {
+      return false;
+    }
+    --count_queued;
+    t();
+    return true;
+  }
+
+  void work(int index) {
+    thread_identity() = {this, index};
+    while(true) {
+      if(runOneTask()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> l(sleep_mutex);
+      sleep_cv.wait(l, [this]() { return stop || count_queued > 0; });
+      if(stop) {
+        return;
+      }
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+  WorkStealingPool(WorkStealingPool&&) = delete;
+  WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+};
@@ -0,0 +1,249 @@
+#include "cplx.c"
+
+/*
+ Kernels of the uniformly partitioned convolution of a tail size (see 'OpenCLUniformPartitionedConvolution'):
+ the ffts are the stockham ffts of vector_fft_floats_stockham_multi_local_coalesce_shift_twiddles.cl,
+ computed by a single workgroup in local memory.
+
+ The build options define:
+ N_LOCAL_BUTTERFLIES       : must be a power of 2
+ N_GLOBAL_BUTTERFLIES      : half the size of the fft, must be a power of 2, and >= N_LOCAL_BUTTERFLIES
+ LOG2_N_GLOBAL_BUTTERFLIES
+ MINUS_PI_over_N_GLOBAL_BUTTERFLIES
+ */
+
+#define N_FFT (2*N_GLOBAL_BUTTERFLIES)
+
+inline int expand(int idxL, int log2N1, int mm) {
+  return ((idxL-mm) << 1) + mm;
+}
+
+// the stockham fft of the N_FFT elements of 'prev', returns the local buffer that contains the result.
+inline __local struct cplx * stockham(__local struct cplx *prev,
+                                      __local struct cplx *next) {
+  int const k = get_global_id(0);
+  int const base_idx = k * N_LOCAL_BUTTERFLIES;
+
+  for(int i=1, LOG2_N_GLOBAL_BUTTERFLIES_over_i = LOG2_N_GLOBAL_BUTTERFLIES, log2i = 0;
+      i <= N_GLOBAL_BUTTERFLIES;
+      i <<= 1, --LOG2_N_GLOBAL_BUTTERFLIES_over_i, ++log2i)
+  {
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int j=0; j<N_LOCAL_BUTTERFLIES; ++j)
+    {
+      int const m = base_idx + j;
+      int const mm = m & (i-1);
+
+      int idxD = expand(m, log2i, mm);
+      int const tIdx = mm << LOG2_N_GLOBAL_BUTTERFLIES_over_i;
+
+      butterfly_outofplace(m,idxD,prev,next, N_GLOBAL_BUTTERFLIES, i,
+                           polar(tIdx * MINUS_PI_over_N_GLOBAL_BUTTERFLIES));
+    }
+
+    // swap(prev,next)
+    {
+      __local struct cplx * tmp = prev;
+      prev = next;
+      next = tmp;
+    }
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+  return prev;
+}
+
+// the bin m (< N_GLOBAL_BUTTERFLIES) of the packed spectrum of real samples (see 'fft_forward')
+inline struct cplx packedBin(__local struct cplx const * spectrum, int const m) {
+  return m ? spectrum[m] : (struct cplx) {
+    .real = spectrum[0].real,
+    .imag = spectrum[N_GLOBAL_BUTTERFLIES].real
+  };
+}
+
+// sum + a * b, for the bin 'bin' of packed spectra (the bin 0 holds 2 real numbers)
+inline struct cplx packedMultAdd(int const bin, struct cplx sum, struct cplx const a, struct cplx const b) {
+  if(bin) {
+    return cplxAdd(sum, cplxMult(a, b));
+  }
+  sum.real += a.real * b.real;
+  sum.imag += a.imag * b.imag;
+  return sum;
+}
+
+// the index, in a packed spectrum, of the bin that the bin m (< N_FFT) is deduced from
+inline int packedIndex(int const m) {
+  if(m == N_GLOBAL_BUTTERFLIES) {
+    return 0;
+  }
+  return (m < N_GLOBAL_BUTTERFLIES) ? m : (N_FFT - m);
+}
+
+// the conjugate of the bin m (< N_FFT) of a hermitian spectrum, where 'c' is the bin 'packedIndex(m)' of its packed form.
+inline struct cplx unpackConjugate(int const m, struct cplx c) {
+  if(m == 0) {
+    return complexFromReal(c.real);
+  }
+  if(m == N_GLOBAL_BUTTERFLIES) {
+    return complexFromReal(c.imag);
+  }
+  if(m < N_GLOBAL_BUTTERFLIES) {
+    c.imag = -c.imag;
+  }
+  return c;
+}
+
+/*
+ The spectrum of the N_FFT real samples of 'input', written in the slot 'slot' of the frequency-domain delay line.
+
+ 'input' is a ring of 2 blocks of N_GLOBAL_BUTTERFLIES samples: the oldest block starts at 'oldest'.
+
+ The spectrum of real samples is hermitian, so a slot has only the N_GLOBAL_BUTTERFLIES first bins,
+ and the real part of the bin N_GLOBAL_BUTTERFLIES (the imaginary parts of the bins 0 and N_GLOBAL_BUTTERFLIES are 0)
+ is packed in the imaginary part of the bin 0.
+ */
+__kernel void fft_forward(__global const float *input,
+                          __global struct cplx *fdl,
+                          int const slot,
+                          int const oldest,
+                          __local struct cplx* pingpong) {
+  int const k = get_global_id(0);
+  __local struct cplx *prev = pingpong;
+  __local struct cplx *next = pingpong + N_FFT;
+
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    // coalesced global memory read, local memory write with no bank conflict.
+    prev[m] = complexFromReal(input[(m + oldest) & (N_FFT-1)]);
+  }
+
+  prev = stockham(prev, next);
+
+  __global struct cplx * output = fdl + slot * N_GLOBAL_BUTTERFLIES;
+  for(int j=0; j<N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    // coalesced global memory write
+    output[m] = packedBin(prev, m);
+  }
+}
+
+/*
+ accum = fdl[head] * ir[0] + fdl[head+1] * ir[1] + ... + fdl[head+n_partitions-1] * ir[n_partitions-1]
+ (the indices of 'fdl' are modulo 'n_partitions'), one bin per work item.
+
+ The spectra are packed (see 'fft_forward'): the bin 0 holds 2 real numbers.
+ */
+__kernel void multiply_add(__global const struct cplx *fdl,
+                           __global const struct cplx *ir,
+                           __global struct cplx *accum,
+                           int const head,
+                           int const n_partitions) {
+  int const bin = get_global_id(0);
+  struct cplx sum = complexFromReal(0.f);
+  __global const struct cplx * f = fdl + head * N_GLOBAL_BUTTERFLIES + bin;
+  __global const struct cplx * h = ir + bin;
+  // the delay line wraps around once: from 'head' to the end, then from the start to 'head'.
+  int const count[2] = { n_partitions - head, head };
+  for(int r=0; r<2; ++r) {
+    for(int p=0; p<count[r]; ++p) {
+      sum = packedMultAdd(bin, sum, *f, *h);
+      f += N_GLOBAL_BUTTERFLIES;
+      h += N_GLOBAL_BUTTERFLIES;
+    }
+    f = fdl + bin;
+  }
+  accum[bin] = sum;
+}
+
+/*
+ The last N_FFT/2 samples of the inverse fft of the packed hermitian spectrum 'accum'
+ (overlap-save: the first half is discarded), unscaled (the scale is applied to the spectra of the impulse response).
+
+ The inverse fft is the conjugate of the fft of the conjugate, and the result is real.
+ */
+__kernel void fft_inverse(__global const struct cplx *accum,
+                          __global float *output,
+                          __local struct cplx* pingpong) {
+  int const k = get_global_id(0);
+  __local struct cplx *prev = pingpong;
+  __local struct cplx *next = pingpong + N_FFT;
+
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    // the conjugate of the bin m, using the symmetry of the spectrum.
+    prev[m] = unpackConjugate(m, accum[packedIndex(m)]);
+  }
+
+  prev = stockham(prev, next);
+
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    if(m >= N_GLOBAL_BUTTERFLIES) {
+      output[m - N_GLOBAL_BUTTERFLIES] = prev[m].real;
+    }
+  }
+}
+
+/*
+ 'fft_forward', 'multiply_add' and 'fft_inverse' in a single kernel, computed by a single workgroup:
+ the spectrum of the input and the spectrum of the output stay in local memory.
+
+ The spectrum of the input is written in the delay line for the next blocks,
+ but its product with the first partition uses the local copy.
+ */
+__kernel void convolve(__global const float *input,
+                       __global struct cplx *fdl,
+                       __global const struct cplx *ir,
+                       __global float *output,
+                       int const head,
+                       int const oldest,
+                       int const n_partitions,
+                       __local struct cplx* pingpong) {
+  int const k = get_global_id(0);
+  __local struct cplx *prev = pingpong;
+  __local struct cplx *next = pingpong + N_FFT;
+
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    prev[m] = complexFromReal(input[(m + oldest) & (N_FFT-1)]);
+  }
+
+  prev = stockham(prev, next);
+  next = (prev == pingpong) ? (pingpong + N_FFT) : pingpong;
+
+  // the multiply-add of 'multiply_add', where the first partition uses the local spectrum.
+  for(int j=0; j<N_LOCAL_BUTTERFLIES; ++j) {
+    int const bin = get_global_size(0) * j + k;
+    struct cplx const x = packedBin(prev, bin);
+    fdl[head * N_GLOBAL_BUTTERFLIES + bin] = x;
+
+    struct cplx sum = packedMultAdd(bin, complexFromReal(0.f), x, ir[bin]);
+    int slot = head;
+    for(int p=1; p<n_partitions; ++p) {
+      if(++slot == n_partitions) {
+        slot = 0;
+      }
+      sum = packedMultAdd(bin, sum, fdl[slot * N_GLOBAL_BUTTERFLIES + bin], ir[p * N_GLOBAL_BUTTERFLIES + bin]);
+    }
+    // the packed spectrum of the output is in the first half of 'next'
+    next[bin] = sum;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // (the spectrum of the input is not needed anymore)
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    prev[m] = unpackConjugate(m, next[packedIndex(m)]);
+  }
+
+  prev = stockham(prev, next);
+
+  for(int j=0; j<2*N_LOCAL_BUTTERFLIES; ++j) {
+    int const m = get_global_size(0) * j + k;
+    if(m >= N_GLOBAL_BUTTERFLIES) {
+      output[m - N_GLOBAL_BUTTERFLIES] = prev[m].real;
+    }
+  }
+}
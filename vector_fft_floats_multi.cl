@@ -1,6 +1,9 @@
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES replace_N_LOCAL_BUTTERFLIES // must be a power of 2
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES : must be a power of 2
+ */
 
 __kernel void kernel_func(__global const float *input, __global const struct cplx *twiddle, __global struct cplx *output) {
   int const k = get_global_id(0);
@@ -1,11 +1,14 @@
 
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES       replace_N_LOCAL_BUTTERFLIES // must be a power of 2
-#define N_GLOBAL_BUTTERFLIES      replace_N_GLOBAL_BUTTERFLIES // must be a power of 2, and >= N_LOCAL_BUTTERFLIES
-#define LOG2_N_GLOBAL_BUTTERFLIES replace_LOG2_N_GLOBAL_BUTTERFLIES
-#define MINUS_PI_over_N_GLOBAL_BUTTERFLIES replace_MINUS_PI_over_N_GLOBAL_BUTTERFLIES
-#define INPUT_SIZE                replace_INPUT_SIZE // must be = 2*N_GLOBAL_BUTTERFLIES
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES                : must be a power of 2
+ N_GLOBAL_BUTTERFLIES               : must be a power of 2, and >= N_LOCAL_BUTTERFLIES
+ LOG2_N_GLOBAL_BUTTERFLIES
+ MINUS_PI_over_N_GLOBAL_BUTTERFLIES
+ INPUT_SIZE                         : must be = 2*N_GLOBAL_BUTTERFLIES
+ */
 #define IMAG_OFFSET               INPUT_SIZE
 
 ////////////////////////////////////////////////////////////////////
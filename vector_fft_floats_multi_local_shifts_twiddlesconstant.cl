@@ -1,8 +1,11 @@
 
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES       replace_N_LOCAL_BUTTERFLIES // must be a power of 2
-#define LOG2_N_GLOBAL_BUTTERFLIES replace_LOG2_N_GLOBAL_BUTTERFLIES
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES       : must be a power of 2
+ LOG2_N_GLOBAL_BUTTERFLIES
+ */
 
 __kernel void kernel_func(__local struct cplx* output, __global const float *input, __constant const struct cplx *twiddle, __global struct cplx *global_output) {
   int const k = get_global_id(0);
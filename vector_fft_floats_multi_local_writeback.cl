@@ -1,6 +1,9 @@
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES replace_N_LOCAL_BUTTERFLIES // must be a power of 2
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES : must be a power of 2
+ */
 
 inline void butterfly_with_writeback(int const idx,
                                      __global struct cplx *g, // we will write back the results to this
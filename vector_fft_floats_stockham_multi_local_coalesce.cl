@@ -1,6 +1,9 @@
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES replace_N_LOCAL_BUTTERFLIES // must be a power of 2
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES : must be a power of 2
+ */
 
 
 inline int expand(int idxL, int N1, int N2) {
@@ -1,7 +1,10 @@
 #include "cplx.c"
 
-#define N_LOCAL_BUTTERFLIES       replace_N_LOCAL_BUTTERFLIES // must be a power of 2
-#define LOG2_N_GLOBAL_BUTTERFLIES replace_LOG2_N_GLOBAL_BUTTERFLIES
+/*
+ The build options define (see 'fftVariant'):
+ N_LOCAL_BUTTERFLIES       : must be a power of 2
+ LOG2_N_GLOBAL_BUTTERFLIES
+ */
 
 
 inline int expand(int idxL, int log2N1, int mm) {